@@ -16,17 +16,21 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #ifdef _WIN32
     #include <ws2tcpip.h>
-    /* Caution: To be used only with fixed length arrays */
-    #define _sprintf(buffer, format, ...) sprintf_s(buffer, sizeof(buffer), format, __VA_ARGS__)
+    #include <afunix.h>
 #else
     #include <arpa/inet.h>
-    /* sprintf() as snprintf does not exist in ANSI C */
-    #define _sprintf(buffer, format, ...) sprintf(buffer, format, __VA_ARGS__)
+    #include <sys/socket.h>
+    #include <sys/uio.h>
+    #include <sys/un.h>
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+    #define CRC32C_CLMUL
+    #include <immintrin.h>
 #endif
 
 #include "proxy_protocol.h"
@@ -190,11 +194,14 @@ static const char *errors[] = {
     "v1 PROXY protocol header: invalid src port",
     "v1 PROXY protocol header: invalid dst port",
     "Heap memory allocation failure",
+    "Fixed capacity storage exhausted",
+    "v2 PROXY protocol header: repeated TLV",
+    "v2 PROXY protocol header: too many TLVs",
 };
 
 const char *pp_strerror(int32_t error)
 {
-    if (error < -ERR_HEAP_ALLOC || error > ERR_NULL)
+    if (error < -ERR_PP2_TLV_COUNT || error > ERR_NULL)
     {
         return NULL;
     }
@@ -212,18 +219,97 @@ static uint8_t parse_port(const char *value, uint16_t *usport)
     return 1;
 }
 
-static pp2_tlv_t *tlv_new(uint8_t type, uint16_t length, const void *value)
+/* Whether the ctx allocates from fixed storage, its arena or its inline storage, instead of the heap */
+static uint8_t pp_ctx_bounded(const pp_ctx_t *ctx)
 {
-    pp2_tlv_t *tlv = malloc(sizeof_pp2_tlv_t + length);
-    if (!tlv)
+    return ctx && (ctx->arena || ctx->flags & PP_CTX_F_NO_HEAP);
+}
+
+/* All the allocations go through here. ctx == NULL is the standard allocator.
+ * bounded tells where from: the fixed storage or the allocator hooks. It is decided by the caller when the storage
+ * is first allocated, since the flags and the arena of the ctx may change before it is released.
+ * Fixed storage cannot grow in place so its "reallocations" copy the old_size bytes still in use
+ */
+static void *pp_ctx_realloc_from(pp_ctx_t *ctx, uint8_t bounded, void *ptr, size_t old_size, size_t size)
+{
+    if (!ctx)
     {
-        return NULL;
+        return realloc(ptr, size);
     }
-    tlv->type = type;
-    tlv->length_hi = length >> 8;
-    tlv->length_lo = length & 0x00ff;
-    memcpy(tlv->value, value, length);
-    return tlv;
+    ctx->stats.allocations++;
+    if (bounded)
+    {
+        uint8_t *storage = ctx->arena ? ctx->arena : (uint8_t*) ctx->inline_storage;
+        uint32_t storage_size = ctx->arena ? ctx->arena_size : sizeof(ctx->inline_storage);
+        /* Keep every allocation aligned the way malloc() would for the pointer arrays and TLVs */
+        uint32_t offset = (ctx->arena_used + 7) & ~7U;
+        if (offset > storage_size || size > storage_size - offset)
+        {
+            return NULL;
+        }
+        void *new_ptr = storage + offset;
+        if (ptr)
+        {
+            memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+        }
+        ctx->arena_used = offset + size;
+        return new_ptr;
+    }
+    return ctx->realloc_fn ? ctx->realloc_fn(ptr, size) : realloc(ptr, size);
+}
+
+static void pp_ctx_release_from(pp_ctx_t *ctx, uint8_t bounded, void *ptr)
+{
+    if (!ctx)
+    {
+        free(ptr);
+    }
+    else if (!bounded)
+    {
+        ctx->free_fn ? ctx->free_fn(ptr) : free(ptr);
+    }
+}
+
+/* For the storage allocated and released within a single call */
+static void *pp_ctx_realloc(pp_ctx_t *ctx, void *ptr, size_t old_size, size_t size)
+{
+    return pp_ctx_realloc_from(ctx, pp_ctx_bounded(ctx), ptr, old_size, size);
+}
+
+static void pp_ctx_release(pp_ctx_t *ctx, void *ptr)
+{
+    pp_ctx_release_from(ctx, pp_ctx_bounded(ctx), ptr);
+}
+
+void pp_ctx_init(pp_ctx_t *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void pp_ctx_set_arena(pp_ctx_t *ctx, void *arena, uint32_t arena_size)
+{
+    ctx->arena = arena;
+    ctx->arena_size = arena ? arena_size : 0;
+    ctx->arena_used = 0;
+}
+
+void pp_ctx_reset_arena(pp_ctx_t *ctx)
+{
+    ctx->arena_used = 0;
+}
+
+void pp_ctx_free(pp_ctx_t *ctx, void *ptr)
+{
+    if (!ctx)
+    {
+        free(ptr);
+        return;
+    }
+    /* Headers outlive the call that created them, so their origin is told from their address */
+    const uint8_t *storage = (const uint8_t*) ctx->inline_storage;
+    uint8_t bounded = ((const uint8_t*) ptr >= storage && (const uint8_t*) ptr < storage + sizeof(ctx->inline_storage))
+                   || (ctx->arena && (const uint8_t*) ptr >= ctx->arena && (const uint8_t*) ptr < ctx->arena + ctx->arena_size);
+    pp_ctx_release_from(ctx, bounded, ptr);
 }
 
 static uint8_t tlv_array_append_tlv(tlv_array_t *tlv_array, pp2_tlv_t *tlv)
@@ -231,8 +317,9 @@ static uint8_t tlv_array_append_tlv(tlv_array_t *tlv_array, pp2_tlv_t *tlv)
     if (!tlv_array->tlvs)
     {
         tlv_array->len = 0;
-        tlv_array->size = 10;
-        tlv_array->tlvs = malloc(tlv_array->size * sizeof(pp2_tlv_t*));
+        /* Fixed storage would waste the copies of a growing array */
+        tlv_array->size = tlv_array->bounded ? PP_CTX_INLINE_TLV_SLOTS : 10;
+        tlv_array->tlvs = pp_ctx_realloc_from(tlv_array->ctx, tlv_array->bounded, NULL, 0, tlv_array->size * sizeof(pp2_tlv_t*));
         if (!tlv_array->tlvs)
         {
             return 0;
@@ -241,12 +328,12 @@ static uint8_t tlv_array_append_tlv(tlv_array_t *tlv_array, pp2_tlv_t *tlv)
 
     if (tlv_array->size == tlv_array->len)
     {
-        tlv_array->size += 5;
-        pp2_tlv_t **tlvs = realloc(tlv_array->tlvs, tlv_array->size * sizeof(pp2_tlv_t*));
+        pp2_tlv_t **tlvs = pp_ctx_realloc_from(tlv_array->ctx, tlv_array->bounded, tlv_array->tlvs, tlv_array->size * sizeof(pp2_tlv_t*), (tlv_array->size + 5) * sizeof(pp2_tlv_t*));
         if (!tlvs)
         {
             return 0;
         }
+        tlv_array->size += 5;
         tlv_array->tlvs = tlvs;
     }
 
@@ -255,47 +342,147 @@ static uint8_t tlv_array_append_tlv(tlv_array_t *tlv_array, pp2_tlv_t *tlv)
     return 1;
 }
 
+/* Appends a new TLV whose value of length bytes is to be written in place by the caller */
+static pp2_tlv_t *tlv_array_append_tlv_alloc(tlv_array_t *tlv_array, uint8_t type, uint16_t length)
+{
+    /* The first allocation decides where all the array's storage comes from */
+    if (!tlv_array->tlvs)
+    {
+        tlv_array->bounded = pp_ctx_bounded(tlv_array->ctx);
+    }
+    pp2_tlv_t *tlv = pp_ctx_realloc_from(tlv_array->ctx, tlv_array->bounded, NULL, 0, sizeof_pp2_tlv_t + length);
+    if (!tlv)
+    {
+        return NULL;
+    }
+    tlv->type = type;
+    tlv->length_hi = length >> 8;
+    tlv->length_lo = length & 0x00ff;
+    if (!tlv_array_append_tlv(tlv_array, tlv))
+    {
+        pp_ctx_release_from(tlv_array->ctx, tlv_array->bounded, tlv);
+        return NULL;
+    }
+    return tlv;
+}
+
 static uint8_t tlv_array_append_tlv_new(tlv_array_t *tlv_array, uint8_t type, uint16_t length, const void *value)
 {
-    pp2_tlv_t *tlv = tlv_new(type, length, value);
-    if (!tlv || !tlv_array_append_tlv(tlv_array, tlv))
+    pp2_tlv_t *tlv = tlv_array_append_tlv_alloc(tlv_array, type, length);
+    if (!tlv)
     {
         return 0;
     }
+    memcpy(tlv->value, value, length);
     return 1;
 }
 
 static uint8_t tlv_array_append_tlv_new_usascii(tlv_array_t *tlv_array, uint8_t type, uint16_t length, const void *value)
 {
-    pp2_tlv_t *tlv = tlv_new(type, length + 1, value);
-    if (!tlv || !tlv_array_append_tlv(tlv_array, tlv))
+    pp2_tlv_t *tlv = tlv_array_append_tlv_alloc(tlv_array, type, length + 1);
+    if (!tlv)
     {
         return 0;
     }
+    memcpy(tlv->value, value, length);
     tlv->value[length] = '\0';
     return 1;
 }
 
-uint8_t pp_info_add_alpn(pp_info_t *pp_info, uint16_t length, const uint8_t *alpn)
+/* Makes sure *buffer can hold at least size bytes, growing it to exactly that through the ctx's allocator. Existing contents are kept */
+static uint8_t buffer_reserve(pp_ctx_t *ctx, uint8_t **buffer, uint32_t *buffer_size, uint32_t size)
 {
-    return tlv_array_append_tlv_new(&pp_info->pp2_info.tlv_array, PP2_TYPE_ALPN, length, alpn);
+    if (*buffer && *buffer_size >= size)
+    {
+        return 1;
+    }
+    uint8_t *new_buffer = pp_ctx_realloc(ctx, *buffer, *buffer ? *buffer_size : 0, size);
+    if (!new_buffer)
+    {
+        return 0;
+    }
+    *buffer = new_buffer;
+    *buffer_size = size;
+    return 1;
 }
 
-uint8_t pp_info_add_authority(pp_info_t *pp_info, uint16_t length, const uint8_t *host_name)
+/* Same as buffer_reserve() but growing geometrically, for the buffers appended to piece by piece */
+static uint8_t buffer_grow(pp_ctx_t *ctx, uint8_t **buffer, uint32_t *buffer_size, uint32_t size)
+{
+    if (*buffer && *buffer_size >= size)
+    {
+        return 1;
+    }
+    uint32_t new_size = *buffer_size ? *buffer_size : 64;
+    while (new_size < size)
+    {
+        new_size *= 2;
+    }
+    return buffer_reserve(ctx, buffer, buffer_size, new_size);
+}
+
+/* Appends a new TLV at the end of the builder's contiguous TLVs. Its value is to be written in place by the caller */
+static pp2_tlv_t *pp_builder_append_tlv_alloc(pp_builder_t *builder, uint8_t type, uint16_t length)
 {
-    return tlv_array_append_tlv_new(&pp_info->pp2_info.tlv_array, PP2_TYPE_AUTHORITY, length, host_name);
+    uint32_t tlvs_len = builder->tlvs_len + sizeof_pp2_tlv_t + length;
+    /* All the TLVs have to fit in the v2 header's 16 bit length */
+    if (tlvs_len > UINT16_MAX || !buffer_grow(NULL, &builder->tlvs, &builder->tlvs_size, tlvs_len))
+    {
+        return NULL;
+    }
+    pp2_tlv_t *tlv = (pp2_tlv_t*) (builder->tlvs + builder->tlvs_len);
+    tlv->type = type;
+    tlv->length_hi = length >> 8;
+    tlv->length_lo = length & 0x00ff;
+    builder->tlvs_len = tlvs_len;
+    return tlv;
 }
 
-uint8_t pp_info_add_unique_id(pp_info_t *pp_info, uint16_t length, const uint8_t *unique_id)
+/* The pp_info_add_*() and pp_builder_add_*() functions share the TLV encoding.
+ * The TLV goes to the builder's storage if one is given else to the pp_info's tlv_array
+ */
+static pp2_tlv_t *tlv_alloc(pp_info_t *pp_info, pp_builder_t *builder, uint8_t type, uint16_t length)
+{
+    if (builder)
+    {
+        return pp_builder_append_tlv_alloc(builder, type, length);
+    }
+    /* The pp_info_get_*() lookups go by the mask */
+    pp2_tlv_t *tlv = tlv_array_append_tlv_alloc(&pp_info->pp2_info.tlv_array, type, length);
+    if (tlv)
+    {
+        PP_TLV_TYPE_MASK_SET(pp_info->pp2_info.tlv_types, type);
+    }
+    return tlv;
+}
+
+static uint8_t tlv_add(pp_info_t *pp_info, pp_builder_t *builder, uint8_t type, uint16_t length, const void *value)
+{
+    pp2_tlv_t *tlv = tlv_alloc(pp_info, builder, type, length);
+    if (!tlv)
+    {
+        return 0;
+    }
+    memcpy(tlv->value, value, length);
+    return 1;
+}
+
+static uint8_t tlv_add_unique_id(pp_info_t *pp_info, pp_builder_t *builder, uint16_t length, const uint8_t *unique_id)
 {
     if (length > 128)
     {
         return 0;
     }
-    return tlv_array_append_tlv_new(&pp_info->pp2_info.tlv_array, PP2_TYPE_UNIQUE_ID, length, unique_id);
+    return tlv_add(pp_info, builder, PP2_TYPE_UNIQUE_ID, length, unique_id);
 }
 
-static void pp_info_add_subtype_ssl(uint8_t *value, uint16_t *index, uint8_t subtype_ssl, uint16_t length, const void *subtype_ssl_value)
+/* Length a SSL sub-TLV occupies in the PP2_TYPE_SSL value. Empty sub-TLVs are omitted */
+static uint32_t tlv_subtype_ssl_len(uint16_t length, const void *subtype_ssl_value)
+{
+    return length && subtype_ssl_value ? sizeof_pp2_tlv_t + length : 0;
+}
+
+static void tlv_add_subtype_ssl(uint8_t *value, uint16_t *index, uint8_t subtype_ssl, uint16_t length, const void *subtype_ssl_value)
 {
     if (!length || !subtype_ssl_value)
     {
@@ -308,83 +495,197 @@ static void pp_info_add_subtype_ssl(uint8_t *value, uint16_t *index, uint8_t sub
     *index += length;
 }
 
-uint8_t pp_info_add_ssl(pp_info_t *pp_info, const char *version, const char *cipher, const char *sig_alg, const char *key_alg, const uint8_t *cn, uint16_t cn_value_len)
+static uint8_t tlv_add_ssl(pp_info_t *pp_info, pp_builder_t *builder, const char *version, uint16_t version_len, const char *cipher, uint16_t cipher_len,
+                           const char *sig_alg, uint16_t sig_alg_len, const char *key_alg, uint16_t key_alg_len, const uint8_t *cn, uint16_t cn_len)
 {
     const pp2_ssl_info_t *pp2_ssl_info = &pp_info->pp2_info.pp2_ssl_info;
-    uint8_t client = pp2_ssl_info->ssl | pp2_ssl_info->cert_in_connection << 1 | pp2_ssl_info->cert_in_connection << 2;
-    uint32_t verify = !pp2_ssl_info->cert_verified;
-    size_t version_value_len = version ? strlen(version) : 0;
-    size_t cipher_value_len = cipher ? strlen(cipher) : 0;
-    size_t sig_alg_value_len = sig_alg ? strlen(sig_alg) : 0;
-    size_t key_alg_value_len = key_alg ? strlen(key_alg) : 0;
-    size_t length = sizeof(client) + sizeof(verify)
-        + sizeof_pp2_tlv_t + version_value_len
-        + sizeof_pp2_tlv_t + cipher_value_len
-        + sizeof_pp2_tlv_t + sig_alg_value_len
-        + sizeof_pp2_tlv_t + key_alg_value_len
-        + sizeof_pp2_tlv_t + cn_value_len;
+    uint8_t client = pp2_ssl_info->ssl | pp2_ssl_info->cert_in_connection << 1 | pp2_ssl_info->cert_in_session << 2;
+    /* Network byte order like every multi byte field, see pp2_parse_tlv_ssl() */
+    uint32_t verify = htonl(!pp2_ssl_info->cert_verified);
+    uint32_t length = sizeof(client) + sizeof(verify)
+        + tlv_subtype_ssl_len(version_len, version)
+        + tlv_subtype_ssl_len(cipher_len, cipher)
+        + tlv_subtype_ssl_len(sig_alg_len, sig_alg)
+        + tlv_subtype_ssl_len(key_alg_len, key_alg)
+        + tlv_subtype_ssl_len(cn_len, cn);
 
     if (length > UINT16_MAX)
     {
         return 0;
     }
 
+    /* Write the sub-TLVs straight into the final TLV */
+    pp2_tlv_t *tlv = tlv_alloc(pp_info, builder, PP2_TYPE_SSL, (uint16_t) length);
+    if (!tlv)
+    {
+        return 0;
+    }
     uint16_t index = 0;
-    uint8_t *value = malloc(length);
-    value[index++] = client;
-    memcpy(value + index, &verify, sizeof(verify));
+    tlv->value[index++] = client;
+    memcpy(tlv->value + index, &verify, sizeof(verify));
     index += sizeof(verify);
-    pp_info_add_subtype_ssl(value, &index, PP2_SUBTYPE_SSL_VERSION, (uint16_t) version_value_len, version);
-    pp_info_add_subtype_ssl(value, &index, PP2_SUBTYPE_SSL_CIPHER, (uint16_t) cipher_value_len, cipher);
-    pp_info_add_subtype_ssl(value, &index, PP2_SUBTYPE_SSL_SIG_ALG, (uint16_t) sig_alg_value_len, sig_alg);
-    pp_info_add_subtype_ssl(value, &index, PP2_SUBTYPE_SSL_KEY_ALG, (uint16_t) key_alg_value_len, key_alg);
-    pp_info_add_subtype_ssl(value, &index, PP2_SUBTYPE_SSL_CN, cn_value_len, cn);
-    uint8_t rc = tlv_array_append_tlv_new(&pp_info->pp2_info.tlv_array, PP2_TYPE_SSL, (uint16_t) length, value);
-    free(value);
-    return rc;
+    tlv_add_subtype_ssl(tlv->value, &index, PP2_SUBTYPE_SSL_VERSION, version_len, version);
+    tlv_add_subtype_ssl(tlv->value, &index, PP2_SUBTYPE_SSL_CIPHER, cipher_len, cipher);
+    tlv_add_subtype_ssl(tlv->value, &index, PP2_SUBTYPE_SSL_SIG_ALG, sig_alg_len, sig_alg);
+    tlv_add_subtype_ssl(tlv->value, &index, PP2_SUBTYPE_SSL_KEY_ALG, key_alg_len, key_alg);
+    tlv_add_subtype_ssl(tlv->value, &index, PP2_SUBTYPE_SSL_CN, cn_len, cn);
+    return 1;
+}
+
+static uint8_t tlv_add_aws_vpce_id(pp_info_t *pp_info, pp_builder_t *builder, uint16_t length, const char *vpce_id)
+{
+    if (length > UINT16_MAX - sizeof_pp2_tlv_aws_t)
+    {
+        return 0;
+    }
+    pp2_tlv_t *tlv = tlv_alloc(pp_info, builder, PP2_TYPE_AWS, sizeof_pp2_tlv_aws_t + length);
+    if (!tlv)
+    {
+        return 0;
+    }
+    pp2_tlv_aws_t *pp2_tlv_aws = (pp2_tlv_aws_t*) tlv->value;
+    pp2_tlv_aws->type = PP2_SUBTYPE_AWS_VPCE_ID;
+    memcpy(pp2_tlv_aws->value, vpce_id, length);
+    return 1;
+}
+
+static uint8_t tlv_add_azure_linkid(pp_info_t *pp_info, pp_builder_t *builder, uint32_t linkid)
+{
+    pp2_tlv_t *tlv = tlv_alloc(pp_info, builder, PP2_TYPE_AZURE, sizeof(pp2_tlv_azure_t));
+    if (!tlv)
+    {
+        return 0;
+    }
+    pp2_tlv_azure_t *pp2_tlv_azure = (pp2_tlv_azure_t*) tlv->value;
+    pp2_tlv_azure->type = PP2_SUBTYPE_AZURE_PRIVATEENDPOINT_LINKID;
+    pp2_tlv_azure->linkid = linkid;
+    return 1;
+}
+
+uint8_t pp_info_add_alpn(pp_info_t *pp_info, uint16_t length, const uint8_t *alpn)
+{
+    return tlv_add(pp_info, NULL, PP2_TYPE_ALPN, length, alpn);
+}
+
+uint8_t pp_info_add_authority(pp_info_t *pp_info, uint16_t length, const uint8_t *host_name)
+{
+    return tlv_add(pp_info, NULL, PP2_TYPE_AUTHORITY, length, host_name);
+}
+
+uint8_t pp_info_add_unique_id(pp_info_t *pp_info, uint16_t length, const uint8_t *unique_id)
+{
+    return tlv_add_unique_id(pp_info, NULL, length, unique_id);
+}
+
+uint8_t pp_info_add_ssl_len(pp_info_t *pp_info, const char *version, uint16_t version_len, const char *cipher, uint16_t cipher_len,
+                            const char *sig_alg, uint16_t sig_alg_len, const char *key_alg, uint16_t key_alg_len, const uint8_t *cn, uint16_t cn_len)
+{
+    return tlv_add_ssl(pp_info, NULL, version, version_len, cipher, cipher_len, sig_alg, sig_alg_len, key_alg, key_alg_len, cn, cn_len);
+}
+
+uint8_t pp_info_add_ssl(pp_info_t *pp_info, const char *version, const char *cipher, const char *sig_alg, const char *key_alg, const uint8_t *cn, uint16_t cn_value_len)
+{
+    size_t version_value_len = version ? strlen(version) : 0;
+    size_t cipher_value_len = cipher ? strlen(cipher) : 0;
+    size_t sig_alg_value_len = sig_alg ? strlen(sig_alg) : 0;
+    size_t key_alg_value_len = key_alg ? strlen(key_alg) : 0;
+    if (version_value_len > UINT16_MAX || cipher_value_len > UINT16_MAX || sig_alg_value_len > UINT16_MAX || key_alg_value_len > UINT16_MAX)
+    {
+        return 0;
+    }
+    return tlv_add_ssl(pp_info, NULL, version, (uint16_t) version_value_len, cipher, (uint16_t) cipher_value_len,
+                       sig_alg, (uint16_t) sig_alg_value_len, key_alg, (uint16_t) key_alg_value_len, cn, cn_value_len);
 }
 
 uint8_t pp_info_add_netns(pp_info_t *pp_info, const char *netns)
 {
-    return tlv_array_append_tlv_new(&pp_info->pp2_info.tlv_array, PP2_TYPE_NETNS, (uint16_t) strlen(netns), netns);
+    return tlv_add(pp_info, NULL, PP2_TYPE_NETNS, (uint16_t) strlen(netns), netns);
+}
+
+uint8_t pp_info_add_aws_vpce_id_len(pp_info_t *pp_info, uint16_t length, const char *vpce_id)
+{
+    return tlv_add_aws_vpce_id(pp_info, NULL, length, vpce_id);
 }
 
 uint8_t pp_info_add_aws_vpce_id(pp_info_t *pp_info, const char *vpce_id)
 {
-    uint16_t length = sizeof_pp2_tlv_aws_t + (uint16_t) strlen(vpce_id);
-    pp2_tlv_aws_t *pp2_tlv_aws = malloc(length);
-    pp2_tlv_aws->type = PP2_SUBTYPE_AWS_VPCE_ID;
-    memcpy(pp2_tlv_aws->value, vpce_id, strlen(vpce_id));
-    uint8_t rc = tlv_array_append_tlv_new(&pp_info->pp2_info.tlv_array, PP2_TYPE_AWS, length, pp2_tlv_aws);
-    free(pp2_tlv_aws);
-    return rc;
+    size_t length = strlen(vpce_id);
+    if (length > UINT16_MAX)
+    {
+        return 0;
+    }
+    return tlv_add_aws_vpce_id(pp_info, NULL, (uint16_t) length, vpce_id);
 }
 
 uint8_t pp_info_add_azure_linkid(pp_info_t *pp_info, uint32_t linkid)
 {
-    uint16_t length = (uint16_t) sizeof(pp2_tlv_azure_t);
-    pp2_tlv_azure_t *pp2_tlv_azure = malloc(length);
-    pp2_tlv_azure->type = PP2_SUBTYPE_AZURE_PRIVATEENDPOINT_LINKID;
-    pp2_tlv_azure->linkid = linkid;
-    uint8_t rc = tlv_array_append_tlv_new(&pp_info->pp2_info.tlv_array, PP2_TYPE_AZURE, length, pp2_tlv_azure);
-    free(pp2_tlv_azure);
-    return rc;
+    return tlv_add_azure_linkid(pp_info, NULL, linkid);
+}
+
+uint8_t pp_builder_add_alpn(pp_builder_t *builder, uint16_t length, const uint8_t *alpn)
+{
+    return tlv_add(&builder->pp_info, builder, PP2_TYPE_ALPN, length, alpn);
+}
+
+uint8_t pp_builder_add_authority(pp_builder_t *builder, uint16_t length, const uint8_t *host_name)
+{
+    return tlv_add(&builder->pp_info, builder, PP2_TYPE_AUTHORITY, length, host_name);
+}
+
+uint8_t pp_builder_add_unique_id(pp_builder_t *builder, uint16_t length, const uint8_t *unique_id)
+{
+    return tlv_add_unique_id(&builder->pp_info, builder, length, unique_id);
+}
+
+uint8_t pp_builder_add_ssl(pp_builder_t *builder, const char *version, uint16_t version_len, const char *cipher, uint16_t cipher_len,
+                           const char *sig_alg, uint16_t sig_alg_len, const char *key_alg, uint16_t key_alg_len, const uint8_t *cn, uint16_t cn_len)
+{
+    return tlv_add_ssl(&builder->pp_info, builder, version, version_len, cipher, cipher_len, sig_alg, sig_alg_len, key_alg, key_alg_len, cn, cn_len);
+}
+
+uint8_t pp_builder_add_netns(pp_builder_t *builder, uint16_t length, const char *netns)
+{
+    return tlv_add(&builder->pp_info, builder, PP2_TYPE_NETNS, length, netns);
+}
+
+uint8_t pp_builder_add_aws_vpce_id(pp_builder_t *builder, uint16_t length, const char *vpce_id)
+{
+    return tlv_add_aws_vpce_id(&builder->pp_info, builder, length, vpce_id);
+}
+
+uint8_t pp_builder_add_azure_linkid(pp_builder_t *builder, uint32_t linkid)
+{
+    return tlv_add_azure_linkid(&builder->pp_info, builder, linkid);
 }
 
 static void tlv_array_clear(tlv_array_t *tlv_array)
 {
     uint32_t i;
-    for (i = 0; i < tlv_array->len; i++)
+    /* Fixed storage may already serve a later parsing, so it is not even written to */
+    for (i = 0; !tlv_array->bounded && i < tlv_array->len; i++)
     {
-        free(tlv_array->tlvs[i]);
+        pp_ctx_release_from(tlv_array->ctx, tlv_array->bounded, tlv_array->tlvs[i]);
         tlv_array->tlvs[i] = NULL;
     }
     tlv_array->len = 0;
     tlv_array->size = 0;
-    free(tlv_array->tlvs);
+    pp_ctx_release_from(tlv_array->ctx, tlv_array->bounded, tlv_array->tlvs);
     tlv_array->tlvs = NULL;
 }
 
+static uint8_t pp_tlv_type_mask_empty(const uint8_t *mask)
+{
+    uint8_t i;
+    for (i = 0; i < PP_TLV_TYPE_MASK_SIZE; i++)
+    {
+        if (mask[i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 static const uint8_t *pp_info_get_tlv_value(const pp_info_t *pp_info, uint8_t type, uint8_t subtype, uint16_t *length)
 {
     *length = 0;
@@ -392,6 +693,11 @@ static const uint8_t *pp_info_get_tlv_value(const pp_info_t *pp_info, uint8_t ty
     {
         return NULL;
     }
+    /* Only a fast negative: a tlv_array filled without recording its types leaves the mask empty and is scanned */
+    if (!PP_TLV_TYPE_MASK_ISSET(pp_info->pp2_info.tlv_types, type) && !pp_tlv_type_mask_empty(pp_info->pp2_info.tlv_types))
+    {
+        return NULL;
+    }
 
     uint32_t i;
     for (i = 0; i < pp_info->pp2_info.tlv_array.len; i++)
@@ -568,262 +874,1801 @@ static uint32_t crctable[256] = {
  0xBE2DA0A5L, 0x4C4623A6L, 0x5F16D052L, 0xAD7D5351L
 };
 
-static uint32_t crc32c(const uint8_t* buf, uint32_t len)
+/* Folds len bytes of buf into a running (non finalized) CRC32c value */
+static uint32_t crc32c_update_table(uint32_t crc, const uint8_t* buf, uint32_t len)
 {
-    uint32_t crc = 0xffffffff;
     while (len-- > 0)
     {
         crc = (crc >> 8) ^ crctable[(crc ^ (*buf++)) & 0xFF];
     }
-    return crc ^ 0xffffffff;
+    return crc;
 }
 
-uint8_t *pp2_create_hdr(const pp_info_t *pp_info, uint16_t *pp2_hdr_len, int32_t *error)
+#ifdef CRC32C_CLMUL
+/* Carry-less multiplication folding, bit reflected (Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ").
+ * A 128 bit accumulator is carried D bits forward onto the data it is XORed with by multiplying its
+ * low quadword with x^(D+31) mod P and its high quadword with x^(D-33) mod P. Its final value, followed by
+ * the unfolded rest, has the same CRC as the whole input and is finished through the table
+ */
+#define CRC32C_FOLD_128_LO   0xf20c0dfe
+#define CRC32C_FOLD_128_HI   0x493c7d27
+#define CRC32C_FOLD_512_LO   0x740eef02
+#define CRC32C_FOLD_512_HI   0x9e4addf8
+#define CRC32C_FOLD_2048_LO  0xdcb17aa4
+#define CRC32C_FOLD_2048_HI  0xb9e02b86
+
+/* Shortest inputs worth each path, measured per call (best of 7 runs) on an AVX-512 Xeon:
+ *      bytes       64    192    1024   4096   6144   7168   8192   16384
+ *      table      157    601    3732  14671  22693  25378  29394  62390 ns
+ *      clmul       38     47     113    264    367    467    548   1035 ns
+ *      vpclmul      -      -     296    349    396    384    385    570 ns
+ * Folding already wins at the 64 bytes it needs, i.e. for every v2 header with TLVs worth checksumming, while
+ * the 512 bit registers only pay for their warm up from about 7 KB
+ */
+#define CRC32C_CLMUL_MIN     64
+#define CRC32C_VPCLMUL_MIN   8192
+
+__attribute__((target("pclmul")))
+static __m128i crc32c_fold_128(__m128i x, __m128i k, __m128i data)
 {
-    proxy_hdr_v2_t proxy_hdr_v2 = { .sig = PP2_SIG, .ver_cmd = '\x21' };
-    uint16_t proxy_addr_len;
-    proxy_addr_t proxy_addr;
-    if (pp_info->address_family == ADDR_FAMILY_UNSPEC)
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)), data);
+}
+
+/* Folds four 128 bit accumulators, 64 bytes apart, and the remaining whole 16 byte blocks into one and finishes the CRC */
+__attribute__((target("pclmul")))
+static uint32_t crc32c_clmul_finish(__m128i x0, __m128i x1, __m128i x2, __m128i x3, const uint8_t *buf, uint32_t len)
+{
+    const __m128i k128 = _mm_set_epi64x(CRC32C_FOLD_128_HI, CRC32C_FOLD_128_LO);
+    __m128i x = crc32c_fold_128(x0, k128, x1);
+    x = crc32c_fold_128(x, k128, x2);
+    x = crc32c_fold_128(x, k128, x3);
+    for (; len >= 16; buf += 16, len -= 16)
     {
-        proxy_addr_len = 0;
-        proxy_hdr_v2.ver_cmd = '\x20';
-        if (!pp_info->pp2_info.local)
+        x = crc32c_fold_128(x, k128, _mm_loadu_si128((const __m128i*) buf));
+    }
+    uint8_t folded[16];
+    _mm_storeu_si128((__m128i*) folded, x);
+    return crc32c_update_table(crc32c_update_table(0, folded, sizeof(folded)), buf, len);
+}
+
+/* Four 128 bit accumulators in flight. len >= 64 */
+__attribute__((target("pclmul")))
+static uint32_t crc32c_update_clmul(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    const __m128i k512 = _mm_set_epi64x(CRC32C_FOLD_512_HI, CRC32C_FOLD_512_LO);
+    /* The running CRC enters XORed into the first 32 bits */
+    __m128i x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*) buf), _mm_cvtsi32_si128((int) crc));
+    __m128i x1 = _mm_loadu_si128((const __m128i*) (buf + 16));
+    __m128i x2 = _mm_loadu_si128((const __m128i*) (buf + 32));
+    __m128i x3 = _mm_loadu_si128((const __m128i*) (buf + 48));
+    for (buf += 64, len -= 64; len >= 64; buf += 64, len -= 64)
+    {
+        x0 = crc32c_fold_128(x0, k512, _mm_loadu_si128((const __m128i*) buf));
+        x1 = crc32c_fold_128(x1, k512, _mm_loadu_si128((const __m128i*) (buf + 16)));
+        x2 = crc32c_fold_128(x2, k512, _mm_loadu_si128((const __m128i*) (buf + 32)));
+        x3 = crc32c_fold_128(x3, k512, _mm_loadu_si128((const __m128i*) (buf + 48)));
+    }
+    return crc32c_clmul_finish(x0, x1, x2, x3, buf, len);
+}
+
+__attribute__((target("avx512f,vpclmulqdq,pclmul")))
+static __m512i crc32c_fold_512(__m512i z, __m512i k, __m512i data)
+{
+    return _mm512_xor_si512(_mm512_xor_si512(_mm512_clmulepi64_epi128(z, k, 0x00), _mm512_clmulepi64_epi128(z, k, 0x11)), data);
+}
+
+/* Same as crc32c_update_clmul() with four 512 bit accumulators, i.e. sixteen 128 bit ones. len >= 256 */
+__attribute__((target("avx512f,vpclmulqdq,pclmul")))
+static uint32_t crc32c_update_vpclmul(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    const __m512i k2048 = _mm512_broadcast_i32x4(_mm_set_epi64x(CRC32C_FOLD_2048_HI, CRC32C_FOLD_2048_LO));
+    const __m512i k512 = _mm512_broadcast_i32x4(_mm_set_epi64x(CRC32C_FOLD_512_HI, CRC32C_FOLD_512_LO));
+    __m512i z0 = _mm512_xor_si512(_mm512_loadu_si512(buf), _mm512_inserti32x4(_mm512_setzero_si512(), _mm_cvtsi32_si128((int) crc), 0));
+    __m512i z1 = _mm512_loadu_si512(buf + 64);
+    __m512i z2 = _mm512_loadu_si512(buf + 128);
+    __m512i z3 = _mm512_loadu_si512(buf + 192);
+    for (buf += 256, len -= 256; len >= 256; buf += 256, len -= 256)
+    {
+        z0 = crc32c_fold_512(z0, k2048, _mm512_loadu_si512(buf));
+        z1 = crc32c_fold_512(z1, k2048, _mm512_loadu_si512(buf + 64));
+        z2 = crc32c_fold_512(z2, k2048, _mm512_loadu_si512(buf + 128));
+        z3 = crc32c_fold_512(z3, k2048, _mm512_loadu_si512(buf + 192));
+    }
+    z0 = crc32c_fold_512(z0, k512, z1);
+    z0 = crc32c_fold_512(z0, k512, z2);
+    z0 = crc32c_fold_512(z0, k512, z3);
+    return crc32c_clmul_finish(_mm512_extracti32x4_epi32(z0, 0), _mm512_extracti32x4_epi32(z0, 1),
+                               _mm512_extracti32x4_epi32(z0, 2), _mm512_extracti32x4_epi32(z0, 3), buf, len);
+}
+
+/* Folding paths the CPU has. Detected once when the library is loaded and only read afterwards,
+ * so it is no mutable state the threads could share
+ */
+#define CRC32C_CPU_CLMUL     0x1
+#define CRC32C_CPU_VPCLMUL   0x2
+
+static uint8_t crc32c_cpu;
+
+__attribute__((constructor))
+static void crc32c_cpu_detect(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("pclmul"))
+    {
+        crc32c_cpu |= CRC32C_CPU_CLMUL;
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("vpclmulqdq"))
         {
-            *error = -ERR_PP2_CMD;
-            return NULL;
+            crc32c_cpu |= CRC32C_CPU_VPCLMUL;
         }
     }
-    else if (pp_info->address_family == ADDR_FAMILY_INET)
+}
+#endif
+
+/* Folds len bytes of buf into a running (non finalized) CRC32c value with the given PP_CRC32C_ENGINE_*.
+ * Automatically, long inputs go to the widest folding path the CPU has and short ones to the table
+ */
+static uint32_t crc32c_update_engine(uint8_t engine, uint32_t crc, const uint8_t* buf, uint32_t len)
+{
+#ifdef CRC32C_CLMUL
+    if (engine != PP_CRC32C_ENGINE_TABLE && len >= CRC32C_CLMUL_MIN)
     {
-        proxy_addr_len = 12;
-        if (inet_pton(AF_INET, pp_info->src_addr, &proxy_addr.ipv4_addr.src_addr) != 1)
+        if (len >= CRC32C_VPCLMUL_MIN && crc32c_cpu & CRC32C_CPU_VPCLMUL)
+        {
+            return crc32c_update_vpclmul(crc, buf, len);
+        }
+        if (crc32c_cpu & CRC32C_CPU_CLMUL)
+        {
+            return crc32c_update_clmul(crc, buf, len);
+        }
+    }
+#else
+    (void) engine;
+#endif
+    return crc32c_update_table(crc, buf, len);
+}
+
+/* The PP2_TYPE_CRC32C value is in network byte order whatever the host byte order, the way HAProxy writes and
+ * checks it with htonl()/ntohl(). Releases before the soname was introduced copied it in host byte order instead
+ */
+static void crc32c_store(uint8_t *dst, uint32_t crc32c)
+{
+    dst[0] = (crc32c >> 24) & 0xff;
+    dst[1] = (crc32c >> 16) & 0xff;
+    dst[2] = (crc32c >> 8) & 0xff;
+    dst[3] = crc32c & 0xff;
+}
+
+static uint32_t crc32c_load(const uint8_t *src)
+{
+    return (uint32_t) src[0] << 24 | (uint32_t) src[1] << 16 | (uint32_t) src[2] << 8 | (uint32_t) src[3];
+}
+
+/* Internal parsing flag next to the PP_CTX_F_* ones: the context selected PP_CRC32C_ENGINE_TABLE */
+#define PP_F_CRC32C_TABLE 0x80000000
+
+#define CRC32C_LANES 4
+
+/* Folds CRC32C_LANES independent buffers at once. Each lookup depends only on the previous one of its own
+ * stream, so interleaving the streams keeps several lookups in flight instead of one per load latency.
+ * The lanes advance together over their common length and finish one by one
+ */
+static void crc32c_update_lanes(uint32_t *crc, const uint8_t **buf, const uint32_t *len)
+{
+    uint32_t c0 = crc[0], c1 = crc[1], c2 = crc[2], c3 = crc[3];
+    const uint8_t *b0 = buf[0], *b1 = buf[1], *b2 = buf[2], *b3 = buf[3];
+    uint32_t common = len[0];
+    uint32_t i;
+    for (i = 1; i < CRC32C_LANES; i++)
+    {
+        if (len[i] < common)
+        {
+            common = len[i];
+        }
+    }
+    for (i = 0; i < common; i++)
+    {
+        c0 = (c0 >> 8) ^ crctable[(c0 ^ b0[i]) & 0xFF];
+        c1 = (c1 >> 8) ^ crctable[(c1 ^ b1[i]) & 0xFF];
+        c2 = (c2 >> 8) ^ crctable[(c2 ^ b2[i]) & 0xFF];
+        c3 = (c3 >> 8) ^ crctable[(c3 ^ b3[i]) & 0xFF];
+    }
+    crc[0] = crc32c_update_table(c0, b0 + common, len[0] - common);
+    crc[1] = crc32c_update_table(c1, b1 + common, len[1] - common);
+    crc[2] = crc32c_update_table(c2, b2 + common, len[2] - common);
+    crc[3] = crc32c_update_table(c3, b3 + common, len[3] - common);
+}
+
+static void crc32c_update_each(uint8_t engine, uint32_t *crc, const uint8_t **buf, const uint32_t *len, uint32_t count)
+{
+    uint32_t i;
+    for (i = 0; i < count; i++)
+    {
+        crc[i] = crc32c_update_engine(engine, crc[i], buf[i], len[i]);
+    }
+}
+
+/* Whether the table is the way for all of a group of lanes. Long inputs are better off folded one by one */
+static uint8_t crc32c_lanes_short(uint8_t engine, const uint32_t *len)
+{
+#ifdef CRC32C_CLMUL
+    uint32_t i;
+    if (engine == PP_CRC32C_ENGINE_TABLE)
+    {
+        return 1;
+    }
+    for (i = 0; i < CRC32C_LANES; i++)
+    {
+        if (len[i] >= CRC32C_CLMUL_MIN)
+        {
+            return 0;
+        }
+    }
+#else
+    (void) engine;
+    (void) len;
+#endif
+    return 1;
+}
+
+/* Folds count independent buffers into their running CRC32c values, CRC32C_LANES at a time, with the given PP_CRC32C_ENGINE_* */
+static void crc32c_update_batch(uint8_t engine, uint32_t *crc, const uint8_t **buf, const uint32_t *len, uint32_t count)
+{
+    uint32_t i;
+    for (i = 0; i + CRC32C_LANES <= count; i += CRC32C_LANES)
+    {
+        if (crc32c_lanes_short(engine, len + i))
+        {
+            crc32c_update_lanes(crc + i, buf + i, len + i);
+        }
+        else
+        {
+            crc32c_update_each(engine, crc + i, buf + i, len + i, CRC32C_LANES);
+        }
+    }
+    crc32c_update_each(engine, crc + i, buf + i, len + i, count - i);
+}
+
+/* A CRC32c calculated while a header is being written */
+typedef struct
+{
+    uint32_t value;
+    uint8_t  engine;
+} crc32c_running_t;
+
+/* Writes a segment of a v2 header at *index and, if crc is given, folds it
+ * into the running CRC32c while it is still hot in the cache.
+ * segment == NULL writes length zero bytes (padding, CRC32c placeholder).
+ * The segment may overlap the destination (in place forwarding)
+ */
+static void pp2_hdr_emit(uint8_t *pp2_hdr, uint16_t *index, const void *segment, uint16_t length, crc32c_running_t *crc)
+{
+    if (segment)
+    {
+        memmove(pp2_hdr + *index, segment, length);
+    }
+    else
+    {
+        memset(pp2_hdr + *index, 0, length);
+    }
+    if (crc)
+    {
+        crc->value = crc32c_update_engine(crc->engine, crc->value, pp2_hdr + *index, length);
+    }
+    *index += length;
+}
+
+/* Length of an AF_UNIX path up to its NULL terminator. A path filling all of its size has none */
+static uint16_t unix_path_len(const void *path, size_t path_size)
+{
+    const uint8_t *terminator = memchr(path, '\0', path_size);
+    return terminator ? (uint16_t) (terminator - (const uint8_t*) path) : (uint16_t) path_size;
+}
+
+/* Copies an AF_UNIX path up to its NULL terminator and zero fills the rest of the 108 bytes.
+ * Only the bytes up to the terminator are looked at as the source may be only partially filled.
+ * Unnamed and abstract sockets end up as an empty address
+ */
+static void unix_path_copy(uint8_t dst[108], const void *path, size_t path_size)
+{
+    uint16_t path_len = unix_path_len(path, path_size < 108 ? path_size : 108);
+    memcpy(dst, path, path_len);
+    memset(dst + path_len, 0, 108 - path_len);
+}
+
+static void sun_path_copy(uint8_t dst[108], const struct sockaddr_un *sun)
+{
+    unix_path_copy(dst, sun->sun_path, sizeof(sun->sun_path));
+}
+
+/* Converts the pp_info's text addresses into their v2 binary form */
+static int32_t pp2_addr_from_pp_info(const pp_info_t *pp_info, proxy_addr_t *proxy_addr, uint16_t *proxy_addr_len)
+{
+    if (pp_info->address_family == ADDR_FAMILY_UNSPEC)
+    {
+        *proxy_addr_len = 0;
+        if (!pp_info->pp2_info.local)
+        {
+            return -ERR_PP2_CMD;
+        }
+    }
+    else if (pp_info->address_family == ADDR_FAMILY_INET)
+    {
+        *proxy_addr_len = 12;
+        if (inet_pton(AF_INET, pp_info->src_addr, &proxy_addr->ipv4_addr.src_addr) != 1)
+        {
+            return -ERR_PP2_IPV4_SRC_IP;
+        }
+        if (inet_pton(AF_INET, pp_info->dst_addr, &proxy_addr->ipv4_addr.dst_addr) != 1)
+        {
+            return -ERR_PP2_IPV4_DST_IP;
+        }
+        proxy_addr->ipv4_addr.src_port = htons(pp_info->src_port);
+        proxy_addr->ipv4_addr.dst_port = htons(pp_info->dst_port);
+    }
+    else if (pp_info->address_family == ADDR_FAMILY_INET6)
+    {
+        *proxy_addr_len = 36;
+        if (inet_pton(AF_INET6, pp_info->src_addr, &proxy_addr->ipv6_addr.src_addr) != 1)
+        {
+            return -ERR_PP2_IPV6_SRC_IP;
+        }
+        if (inet_pton(AF_INET6, pp_info->dst_addr, &proxy_addr->ipv6_addr.dst_addr) != 1)
+        {
+            return -ERR_PP2_IPV6_DST_IP;
+        }
+        proxy_addr->ipv6_addr.src_port = htons(pp_info->src_port);
+        proxy_addr->ipv6_addr.dst_port = htons(pp_info->dst_port);
+    }
+    else if (pp_info->address_family == ADDR_FAMILY_UNIX)
+    {
+        *proxy_addr_len = 216;
+        unix_path_copy(proxy_addr->unix_addr.src_addr, pp_info->src_addr, sizeof(pp_info->src_addr));
+        unix_path_copy(proxy_addr->unix_addr.dst_addr, pp_info->dst_addr, sizeof(pp_info->dst_addr));
+    }
+    else
+    {
+        return -ERR_PP2_ADDR_FAMILY;
+    }
+    return ERR_NULL;
+}
+
+/* Converts a pair of sockaddr into their v2 binary form. Both have to be of the same family */
+static int32_t pp2_addr_from_sockaddr(const struct sockaddr *src, const struct sockaddr *dst, proxy_addr_t *proxy_addr, uint16_t *proxy_addr_len, uint8_t *address_family)
+{
+    if (src->sa_family != dst->sa_family)
+    {
+        return -ERR_PP2_ADDR_FAMILY;
+    }
+
+    if (src->sa_family == AF_INET)
+    {
+        const struct sockaddr_in *src_in = (const struct sockaddr_in*) src;
+        const struct sockaddr_in *dst_in = (const struct sockaddr_in*) dst;
+        *address_family = ADDR_FAMILY_INET;
+        *proxy_addr_len = 12;
+        memcpy(&proxy_addr->ipv4_addr.src_addr, &src_in->sin_addr, sizeof(proxy_addr->ipv4_addr.src_addr));
+        memcpy(&proxy_addr->ipv4_addr.dst_addr, &dst_in->sin_addr, sizeof(proxy_addr->ipv4_addr.dst_addr));
+        /* Already in network byte order */
+        proxy_addr->ipv4_addr.src_port = src_in->sin_port;
+        proxy_addr->ipv4_addr.dst_port = dst_in->sin_port;
+    }
+    else if (src->sa_family == AF_INET6)
+    {
+        const struct sockaddr_in6 *src_in6 = (const struct sockaddr_in6*) src;
+        const struct sockaddr_in6 *dst_in6 = (const struct sockaddr_in6*) dst;
+        *address_family = ADDR_FAMILY_INET6;
+        *proxy_addr_len = 36;
+        memcpy(proxy_addr->ipv6_addr.src_addr, &src_in6->sin6_addr, sizeof(proxy_addr->ipv6_addr.src_addr));
+        memcpy(proxy_addr->ipv6_addr.dst_addr, &dst_in6->sin6_addr, sizeof(proxy_addr->ipv6_addr.dst_addr));
+        proxy_addr->ipv6_addr.src_port = src_in6->sin6_port;
+        proxy_addr->ipv6_addr.dst_port = dst_in6->sin6_port;
+    }
+    else if (src->sa_family == AF_UNIX)
+    {
+        *address_family = ADDR_FAMILY_UNIX;
+        *proxy_addr_len = 216;
+        sun_path_copy(proxy_addr->unix_addr.src_addr, (const struct sockaddr_un*) src);
+        sun_path_copy(proxy_addr->unix_addr.dst_addr, (const struct sockaddr_un*) dst);
+    }
+    else
+    {
+        return -ERR_PP2_ADDR_FAMILY;
+    }
+    return ERR_NULL;
+}
+
+/* Writes a v2 header into *buffer, growing it with buffer_reserve() if needed.
+ * The address family overrides the pp_info's one. The TLVs are the pp_info's tlv_array ones followed by the already encoded tlvs of tlvs_len bytes.
+ * With crc32c_offset the checksum is left zeroed and its offset returned there (0: none), for pp2_crc32c_batch_flush() to fill in
+ */
+static uint8_t pp2_hdr_write(pp_ctx_t *ctx, const pp_info_t *pp_info, uint8_t address_family, const proxy_addr_t *proxy_addr, uint16_t proxy_addr_len,
+                             const uint8_t *tlvs, uint32_t tlvs_len, uint8_t **buffer, uint32_t *buffer_size, uint16_t *pp2_hdr_len,
+                             uint32_t *crc32c_offset, int32_t *error)
+{
+    proxy_hdr_v2_t proxy_hdr_v2 = { .sig = PP2_SIG, .ver_cmd = '\x21' };
+    if (address_family == ADDR_FAMILY_UNSPEC)
+    {
+        proxy_hdr_v2.ver_cmd = '\x20';
+    }
+
+    if (pp_info->transport_protocol > TRANSPORT_PROTOCOL_DGRAM)
+    {
+        *error = -ERR_PP2_TRANSPORT_PROTOCOL;
+        return 0;
+    }
+
+    proxy_hdr_v2.fam = address_family << 4 | pp_info->transport_protocol;
+
+    /* Calculate the total length */
+    uint32_t len = proxy_addr_len + tlvs_len;
+    const tlv_array_t *tlv_array = &pp_info->pp2_info.tlv_array;
+    uint16_t padding_bytes = 0;
+    uint32_t i;
+    for (i = 0; i < tlv_array->len; i++)
+    {
+        uint16_t tlv_len = sizeof_pp2_tlv_t + (tlv_array->tlvs[i]->length_hi << 8 | tlv_array->tlvs[i]->length_lo);
+        len += tlv_len;
+    }
+    if (pp_info->pp2_info.crc32c)
+    {
+        len += sizeof_pp2_tlv_t + sizeof(uint32_t);
+    }
+    uint32_t hdr_len = sizeof(proxy_hdr_v2_t) + len;
+    if (pp_info->pp2_info.alignment_power > 1)
+    {
+        uint16_t alignment = 1 << pp_info->pp2_info.alignment_power;
+        if (hdr_len % alignment)
+        {
+            uint32_t hdr_len_padded = (hdr_len / alignment + 1) * alignment;
+            /* The NOOP TLV needs to be at least 3 bytes because a TLV can not be smaller than that */
+            if (hdr_len_padded - hdr_len < sizeof_pp2_tlv_t)
+            {
+                hdr_len_padded += alignment;
+            }
+            padding_bytes = hdr_len_padded - sizeof(proxy_hdr_v2_t) - len - sizeof_pp2_tlv_t;
+
+            hdr_len = hdr_len_padded;
+            len = hdr_len_padded - sizeof(proxy_hdr_v2_t);
+        }
+    }
+    if (len > UINT16_MAX || hdr_len > UINT16_MAX)
+    {
+        *error = -ERR_PP2_LENGTH;
+        return 0;
+    }
+    *pp2_hdr_len = hdr_len;
+    proxy_hdr_v2.len = htons(len);
+
+    /* Create the PROXY protocol header */
+    if (!buffer_reserve(ctx, buffer, buffer_size, hdr_len))
+    {
+        *error = -ERR_HEAP_ALLOC;
+        return 0;
+    }
+    uint8_t *pp2_hdr = *buffer;
+    /* Emit the header in a single pass, checksumming each segment as it is written */
+    crc32c_running_t crc32c_running = { 0xffffffff, ctx ? ctx->crc32c_engine : PP_CRC32C_ENGINE_AUTO };
+    crc32c_running_t *crc = pp_info->pp2_info.crc32c && !crc32c_offset ? &crc32c_running : NULL;
+    uint16_t index = 0;
+    pp2_hdr_emit(pp2_hdr, &index, &proxy_hdr_v2, sizeof(proxy_hdr_v2_t), crc);
+    pp2_hdr_emit(pp2_hdr, &index, proxy_addr, proxy_addr_len, crc);
+
+    /* Append the TLVs */
+    for (i = 0; i < tlv_array->len; i++)
+    {
+        uint16_t tlv_len = sizeof_pp2_tlv_t + (tlv_array->tlvs[i]->length_hi << 8 | tlv_array->tlvs[i]->length_lo);
+        pp2_hdr_emit(pp2_hdr, &index, tlv_array->tlvs[i], tlv_len, crc);
+    }
+    if (tlvs_len)
+    {
+        pp2_hdr_emit(pp2_hdr, &index, tlvs, tlvs_len, crc);
+    }
+    if (pp_info->pp2_info.alignment_power > 1)
+    {
+        pp2_tlv_t tlv = {
+            .type = PP2_TYPE_NOOP,
+            .length_hi = padding_bytes >> 8,
+            .length_lo = padding_bytes & 0x00ff
+        };
+        pp2_hdr_emit(pp2_hdr, &index, &tlv, sizeof_pp2_tlv_t, crc);
+        pp2_hdr_emit(pp2_hdr, &index, NULL, padding_bytes, crc);
+    }
+    if (pp_info->pp2_info.crc32c)
+    {
+        pp2_tlv_t tlv = { .type = PP2_TYPE_CRC32C, .length_lo = sizeof(uint32_t) };
+        pp2_hdr_emit(pp2_hdr, &index, &tlv, sizeof_pp2_tlv_t, crc);
+        /* The checksum is calculated with its own value field set to zero */
+        uint16_t crc32c_index = index;
+        pp2_hdr_emit(pp2_hdr, &index, NULL, sizeof(uint32_t), crc);
+        if (crc32c_offset)
+        {
+            *crc32c_offset = crc32c_index;
+        }
+        else
+        {
+            crc32c_store(pp2_hdr + crc32c_index, crc32c_running.value ^ 0xffffffff);
+        }
+    }
+    else if (crc32c_offset)
+    {
+        *crc32c_offset = 0;
+    }
+
+    *error = ERR_NULL;
+    return 1;
+}
+
+static uint8_t *pp2_create_hdr(pp_ctx_t *ctx, const pp_info_t *pp_info, uint16_t *pp2_hdr_len, uint32_t *crc32c_offset, int32_t *error)
+{
+    proxy_addr_t proxy_addr;
+    uint16_t proxy_addr_len;
+    *error = pp2_addr_from_pp_info(pp_info, &proxy_addr, &proxy_addr_len);
+    if (*error != ERR_NULL)
+    {
+        return NULL;
+    }
+
+    uint8_t *pp2_hdr = NULL;
+    uint32_t pp2_hdr_size = 0;
+    if (!pp2_hdr_write(ctx, pp_info, pp_info->address_family, &proxy_addr, proxy_addr_len, NULL, 0, &pp2_hdr, &pp2_hdr_size, pp2_hdr_len, crc32c_offset, error))
+    {
+        pp_ctx_release(ctx, pp2_hdr);
+        return NULL;
+    }
+    return pp2_hdr;
+}
+
+/* LOCAL, AF_UNSPEC, no addresses: what pp2_create_hdr() would create for a healthcheck */
+static const uint8_t pp2_healthcheck_hdr[] = {
+    0x0d, 0x0a, 0x0d, 0x0a, 0x00, 0x0d, 0x0a, 0x51, 0x55, 0x49, 0x54, 0x0a, /* v2 signature */
+    0x20, 0x00, 0x00, 0x00                                                  /* ver_cmd, fam and len */
+};
+
+/* Same as above followed by a PP2_TYPE_CRC32C TLV. Its checksum 0xa9b87e8f is in network byte order, see crc32c_store() */
+static const uint8_t pp2_healthcheck_hdr_crc32c[] = {
+    0x0d, 0x0a, 0x0d, 0x0a, 0x00, 0x0d, 0x0a, 0x51, 0x55, 0x49, 0x54, 0x0a, /* v2 signature */
+    0x20, 0x00, 0x00, 0x07,                                                 /* ver_cmd, fam and len */
+    0x03, 0x00, 0x04, 0xa9, 0xb8, 0x7e, 0x8f                                /* CRC32C TLV */
+};
+
+const uint8_t *pp2_get_healthcheck_hdr(uint8_t crc32c, uint16_t *pp2_hdr_len)
+{
+    if (crc32c)
+    {
+        *pp2_hdr_len = sizeof(pp2_healthcheck_hdr_crc32c);
+        return pp2_healthcheck_hdr_crc32c;
+    }
+    *pp2_hdr_len = sizeof(pp2_healthcheck_hdr);
+    return pp2_healthcheck_hdr;
+}
+
+uint16_t pp2_is_healthcheck_hdr(const uint8_t *buffer, uint32_t buffer_length)
+{
+    if (buffer_length < sizeof(pp2_healthcheck_hdr) || memcmp(buffer, pp2_healthcheck_hdr, sizeof(pp2_healthcheck_hdr) - 1))
+    {
+        return 0;
+    }
+    /* Only the last byte (len) differs between the two variants */
+    if (buffer[sizeof(pp2_healthcheck_hdr) - 1] == 0x00)
+    {
+        return sizeof(pp2_healthcheck_hdr);
+    }
+    if (buffer_length >= sizeof(pp2_healthcheck_hdr_crc32c)
+        && !memcmp(buffer + sizeof(pp2_healthcheck_hdr) - 1, pp2_healthcheck_hdr_crc32c + sizeof(pp2_healthcheck_hdr) - 1,
+                   sizeof(pp2_healthcheck_hdr_crc32c) - sizeof(pp2_healthcheck_hdr) + 1))
+    {
+        return sizeof(pp2_healthcheck_hdr_crc32c);
+    }
+    return 0;
+}
+
+uint8_t *pp2_create_healthcheck_hdr(uint16_t *pp2_hdr_len, int32_t *error)
+{
+    const uint8_t *healthcheck_hdr = pp2_get_healthcheck_hdr(0, pp2_hdr_len);
+    uint8_t *pp2_hdr = malloc(*pp2_hdr_len);
+    if (!pp2_hdr)
+    {
+        *error = -ERR_HEAP_ALLOC;
+        return NULL;
+    }
+    memcpy(pp2_hdr, healthcheck_hdr, *pp2_hdr_len);
+    *error = ERR_NULL;
+    return pp2_hdr;
+}
+
+/* "00" "01" ... "99" */
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/* Formats a value of up to 5 digits, e.g. a port, in decimal without leading zeros. Returns the number of chars written */
+static uint8_t pp1_format_u16(char *out, uint16_t value)
+{
+    char digits[5];
+    uint8_t len = 0;
+    while (value >= 100)
+    {
+        uint16_t pair = value % 100;
+        value /= 100;
+        digits[4 - len++] = digit_pairs[pair * 2 + 1];
+        digits[4 - len++] = digit_pairs[pair * 2];
+    }
+    if (value >= 10)
+    {
+        digits[4 - len++] = digit_pairs[value * 2 + 1];
+        digits[4 - len++] = digit_pairs[value * 2];
+    }
+    else
+    {
+        digits[4 - len++] = '0' + value;
+    }
+    memcpy(out, digits + 5 - len, len);
+    return len;
+}
+
+/* Formats an IPv4 address in dotted decimal. Returns the number of chars written */
+static uint8_t pp1_format_ipv4(char *out, const uint8_t *addr)
+{
+    uint8_t len = 0;
+    uint8_t i;
+    for (i = 0; i < 4; i++)
+    {
+        if (i)
+        {
+            out[len++] = '.';
+        }
+        len += pp1_format_u16(out + len, addr[i]);
+    }
+    return len;
+}
+
+/* Formats an IPv6 address the way inet_ntop() does (RFC 5952): lower case hex without leading zeros,
+ * the longest run of two or more zero groups compressed to "::" and IPv4 mapped/compatible addresses
+ * with the IPv4 dotted decimal tail. Returns the number of chars written
+ */
+static uint8_t pp1_format_ipv6(char *out, const uint8_t *addr)
+{
+    uint16_t words[8];
+    int8_t best_base = -1, best_len = 0, cur_base = -1, cur_len = 0;
+    uint8_t len = 0;
+    uint8_t i;
+    for (i = 0; i < 8; i++)
+    {
+        words[i] = addr[2 * i] << 8 | addr[2 * i + 1];
+        if (!words[i])
+        {
+            if (cur_base == -1)
+            {
+                cur_base = i;
+                cur_len = 0;
+            }
+            cur_len++;
+            if (cur_len > best_len)
+            {
+                best_base = cur_base;
+                best_len = cur_len;
+            }
+        }
+        else
+        {
+            cur_base = -1;
+        }
+    }
+    if (best_len < 2)
+    {
+        best_base = -1;
+    }
+
+    for (i = 0; i < 8; i++)
+    {
+        if (best_base != -1 && i >= best_base && i < best_base + best_len)
+        {
+            if (i == best_base)
+            {
+                out[len++] = ':';
+            }
+            continue;
+        }
+        if (i)
+        {
+            out[len++] = ':';
+        }
+        /* IPv4 compatible (::a.b.c.d) or mapped (::ffff:a.b.c.d) */
+        if (i == 6 && best_base == 0 && (best_len == 6 || (best_len == 5 && words[5] == 0xffff)))
+        {
+            return len + pp1_format_ipv4(out + len, addr + 12);
+        }
+        uint16_t word = words[i];
+        if (word >= 0x1000)
+        {
+            out[len++] = hex_digits[word >> 12];
+        }
+        if (word >= 0x100)
+        {
+            out[len++] = hex_digits[(word >> 8) & 0xf];
+        }
+        if (word >= 0x10)
+        {
+            out[len++] = hex_digits[(word >> 4) & 0xf];
+        }
+        out[len++] = hex_digits[word & 0xf];
+    }
+    if (best_base != -1 && best_base + best_len == 8)
+    {
+        out[len++] = ':';
+    }
+    return len;
+}
+
+/* Writes the v1 line for binary addresses (in_addr/in6_addr layout) into *buffer, growing it with buffer_reserve() if needed.
+ * The line is formatted on the stack first so that exactly its length is reserved
+ */
+static uint8_t pp1_hdr_write_line(pp_ctx_t *ctx, uint8_t address_family, const uint8_t *src_addr, const uint8_t *dst_addr, uint16_t src_port, uint16_t dst_port,
+                                  uint8_t **buffer, uint32_t *buffer_size, uint16_t *pp1_hdr_len, int32_t *error)
+{
+    char line[PP1_MAX_LENGHT];
+    uint16_t len;
+    if (address_family == ADDR_FAMILY_UNSPEC)
+    {
+        static const char str[] = "PROXY UNKNOWN"CRLF;
+        len = sizeof(str) - 1;
+        memcpy(line, str, len);
+    }
+    else
+    {
+        uint8_t (*format_addr)(char*, const uint8_t*) = pp1_format_ipv4;
+        if (address_family == ADDR_FAMILY_INET)
+        {
+            memcpy(line, "PROXY TCP4 ", 11);
+        }
+        else
+        {
+            memcpy(line, "PROXY TCP6 ", 11);
+            format_addr = pp1_format_ipv6;
+        }
+        len = 11;
+        len += format_addr(line + len, src_addr);
+        line[len++] = ' ';
+        len += format_addr(line + len, dst_addr);
+        line[len++] = ' ';
+        len += pp1_format_u16(line + len, src_port);
+        line[len++] = ' ';
+        len += pp1_format_u16(line + len, dst_port);
+        line[len++] = '\r';
+        line[len++] = '\n';
+    }
+
+    if (!buffer_reserve(ctx, buffer, buffer_size, len))
+    {
+        *error = -ERR_HEAP_ALLOC;
+        return 0;
+    }
+    memcpy(*buffer, line, len);
+    *pp1_hdr_len = len;
+    *error = ERR_NULL;
+    return 1;
+}
+
+/* Writes a v1 header into *buffer, growing it with buffer_reserve() if needed */
+static uint8_t pp1_hdr_write(pp_ctx_t *ctx, const pp_info_t *pp_info, uint8_t **buffer, uint32_t *buffer_size, uint16_t *pp1_hdr_len, int32_t *error)
+{
+    if (pp_info->transport_protocol != TRANSPORT_PROTOCOL_UNSPEC && pp_info->transport_protocol != TRANSPORT_PROTOCOL_STREAM)
+    {
+        *error = -ERR_PP1_TRANSPORT_FAMILY;
+        return 0;
+    }
+
+    /* The text addresses are validated and converted at once. The line is then formatted from the binary form */
+    struct in6_addr src_addr;
+    struct in6_addr dst_addr;
+    if (pp_info->address_family == ADDR_FAMILY_INET)
+    {
+        if (inet_pton(AF_INET, pp_info->src_addr, &src_addr) != 1)
+        {
+            *error = -ERR_PP1_IPV4_SRC_IP;
+            return 0;
+        }
+        if (inet_pton(AF_INET, pp_info->dst_addr, &dst_addr) != 1)
+        {
+            *error = -ERR_PP1_IPV4_DST_IP;
+            return 0;
+        }
+    }
+    else if (pp_info->address_family == ADDR_FAMILY_INET6)
+    {
+        if (inet_pton(AF_INET6, pp_info->src_addr, &src_addr) != 1)
+        {
+            *error = -ERR_PP1_IPV6_SRC_IP;
+            return 0;
+        }
+        if (inet_pton(AF_INET6, pp_info->dst_addr, &dst_addr) != 1)
+        {
+            *error = -ERR_PP1_IPV6_DST_IP;
+            return 0;
+        }
+    }
+    else if (pp_info->address_family != ADDR_FAMILY_UNSPEC)
+    {
+        *error = -ERR_PP1_TRANSPORT_FAMILY;
+        return 0;
+    }
+
+    return pp1_hdr_write_line(ctx, pp_info->address_family, (const uint8_t*) &src_addr, (const uint8_t*) &dst_addr, pp_info->src_port, pp_info->dst_port,
+                              buffer, buffer_size, pp1_hdr_len, error);
+}
+
+/* Writes a v1 header for a pair of sockaddr into *buffer, growing it with buffer_reserve() if needed */
+static uint8_t pp1_hdr_write_sockaddr(const pp_info_t *pp_info, const struct sockaddr *src, const struct sockaddr *dst,
+                                      uint8_t **buffer, uint32_t *buffer_size, uint16_t *pp1_hdr_len, int32_t *error)
+{
+    if (pp_info->transport_protocol != TRANSPORT_PROTOCOL_UNSPEC && pp_info->transport_protocol != TRANSPORT_PROTOCOL_STREAM)
+    {
+        *error = -ERR_PP1_TRANSPORT_FAMILY;
+        return 0;
+    }
+
+    if (src->sa_family == AF_INET && dst->sa_family == AF_INET)
+    {
+        const struct sockaddr_in *src_in = (const struct sockaddr_in*) src;
+        const struct sockaddr_in *dst_in = (const struct sockaddr_in*) dst;
+        return pp1_hdr_write_line(NULL, ADDR_FAMILY_INET, (const uint8_t*) &src_in->sin_addr, (const uint8_t*) &dst_in->sin_addr,
+                                  ntohs(src_in->sin_port), ntohs(dst_in->sin_port), buffer, buffer_size, pp1_hdr_len, error);
+    }
+    else if (src->sa_family == AF_INET6 && dst->sa_family == AF_INET6)
+    {
+        const struct sockaddr_in6 *src_in6 = (const struct sockaddr_in6*) src;
+        const struct sockaddr_in6 *dst_in6 = (const struct sockaddr_in6*) dst;
+        return pp1_hdr_write_line(NULL, ADDR_FAMILY_INET6, (const uint8_t*) &src_in6->sin6_addr, (const uint8_t*) &dst_in6->sin6_addr,
+                                  ntohs(src_in6->sin6_port), ntohs(dst_in6->sin6_port), buffer, buffer_size, pp1_hdr_len, error);
+    }
+
+    /* v1 has no AF_UNIX */
+    *error = -ERR_PP1_TRANSPORT_FAMILY;
+    return 0;
+}
+
+/* Writes a header of the given version for a pair of sockaddr into *buffer */
+static uint8_t pp_hdr_write_sockaddr(uint8_t version, const pp_info_t *pp_info, const uint8_t *tlvs, uint32_t tlvs_len,
+                                     const struct sockaddr *src, const struct sockaddr *dst,
+                                     uint8_t **buffer, uint32_t *buffer_size, uint16_t *pp_hdr_len, int32_t *error)
+{
+    if (version == 2)
+    {
+        proxy_addr_t proxy_addr;
+        uint16_t proxy_addr_len;
+        uint8_t address_family;
+        *error = pp2_addr_from_sockaddr(src, dst, &proxy_addr, &proxy_addr_len, &address_family);
+        if (*error != ERR_NULL)
+        {
+            return 0;
+        }
+        return pp2_hdr_write(NULL, pp_info, address_family, &proxy_addr, proxy_addr_len, tlvs, tlvs_len, buffer, buffer_size, pp_hdr_len, NULL, error);
+    }
+    else if (version == 1)
+    {
+        return pp1_hdr_write_sockaddr(pp_info, src, dst, buffer, buffer_size, pp_hdr_len, error);
+    }
+    *error = -ERR_PP_VERSION;
+    return 0;
+}
+
+static uint8_t *pp1_create_hdr(pp_ctx_t *ctx, const pp_info_t *pp_info, uint16_t *pp1_hdr_len, int32_t *error)
+{
+    uint8_t *pp1_hdr = NULL;
+    uint32_t pp1_hdr_size = 0;
+    if (!pp1_hdr_write(ctx, pp_info, &pp1_hdr, &pp1_hdr_size, pp1_hdr_len, error))
+    {
+        pp_ctx_release(ctx, pp1_hdr);
+        return NULL;
+    }
+    return pp1_hdr;
+}
+
+/* Updates the context's create statistics and reports an exhausted arena or inline storage as such */
+static void pp_ctx_count_create(pp_ctx_t *ctx, const uint8_t *pp_hdr, int32_t *error)
+{
+    if (ctx)
+    {
+        pp_hdr ? ctx->stats.created++ : ctx->stats.create_errors++;
+        if (*error == -ERR_HEAP_ALLOC && pp_ctx_bounded(ctx))
+        {
+            *error = -ERR_PP_CAPACITY;
+        }
+    }
+}
+
+uint8_t *pp_create_hdr_ctx(pp_ctx_t *ctx, uint8_t version, const pp_info_t *pp_info, uint16_t *pp_hdr_len, int32_t *error)
+{
+    uint8_t *pp_hdr;
+    if (version == 2)
+    {
+        pp_hdr = pp2_create_hdr(ctx, pp_info, pp_hdr_len, NULL, error);
+    }
+    else if (version == 1)
+    {
+        pp_hdr = pp1_create_hdr(ctx, pp_info, pp_hdr_len, error);
+    }
+    else
+    {
+        *error = -ERR_PP_VERSION;
+        pp_hdr = NULL;
+    }
+
+    pp_ctx_count_create(ctx, pp_hdr, error);
+    return pp_hdr;
+}
+
+uint8_t *pp_create_hdr(uint8_t version, const pp_info_t *pp_info, uint16_t *pp_hdr_len, int32_t *error)
+{
+    return pp_create_hdr_ctx(NULL, version, pp_info, pp_hdr_len, error);
+}
+
+uint8_t *pp_create_hdr_from_sockaddr(uint8_t version, const pp_info_t *pp_info, const struct sockaddr *src, const struct sockaddr *dst, uint16_t *pp_hdr_len, int32_t *error)
+{
+    uint8_t *pp_hdr = NULL;
+    uint32_t pp_hdr_size = 0;
+    if (!pp_hdr_write_sockaddr(version, pp_info, NULL, 0, src, dst, &pp_hdr, &pp_hdr_size, pp_hdr_len, error))
+    {
+        free(pp_hdr);
+        return NULL;
+    }
+    return pp_hdr;
+}
+
+uint8_t pp_info_from_socket(int fd, pp_info_t *pp_info)
+{
+    struct sockaddr_storage src;
+    struct sockaddr_storage dst;
+    socklen_t src_len = sizeof(src);
+    socklen_t dst_len = sizeof(dst);
+    int type;
+    socklen_t type_len = sizeof(type);
+    memset(&src, 0, sizeof(src));
+    memset(&dst, 0, sizeof(dst));
+    /* The source is the client i.e. the peer, the destination is where it connected to i.e. us */
+    if (getpeername(fd, (struct sockaddr*) &src, &src_len)
+        || getsockname(fd, (struct sockaddr*) &dst, &dst_len)
+        || getsockopt(fd, SOL_SOCKET, SO_TYPE, (char*) &type, &type_len))
+    {
+        return 0;
+    }
+
+    if (src.ss_family == AF_INET && dst.ss_family == AF_INET)
+    {
+        const struct sockaddr_in *src_in = (const struct sockaddr_in*) &src;
+        const struct sockaddr_in *dst_in = (const struct sockaddr_in*) &dst;
+        if (!inet_ntop(AF_INET, &src_in->sin_addr, pp_info->src_addr, sizeof(pp_info->src_addr))
+            || !inet_ntop(AF_INET, &dst_in->sin_addr, pp_info->dst_addr, sizeof(pp_info->dst_addr)))
+        {
+            return 0;
+        }
+        pp_info->address_family = ADDR_FAMILY_INET;
+        pp_info->src_port = ntohs(src_in->sin_port);
+        pp_info->dst_port = ntohs(dst_in->sin_port);
+    }
+    else if (src.ss_family == AF_INET6 && dst.ss_family == AF_INET6)
+    {
+        const struct sockaddr_in6 *src_in6 = (const struct sockaddr_in6*) &src;
+        const struct sockaddr_in6 *dst_in6 = (const struct sockaddr_in6*) &dst;
+        if (!inet_ntop(AF_INET6, &src_in6->sin6_addr, pp_info->src_addr, sizeof(pp_info->src_addr))
+            || !inet_ntop(AF_INET6, &dst_in6->sin6_addr, pp_info->dst_addr, sizeof(pp_info->dst_addr)))
+        {
+            return 0;
+        }
+        pp_info->address_family = ADDR_FAMILY_INET6;
+        pp_info->src_port = ntohs(src_in6->sin6_port);
+        pp_info->dst_port = ntohs(dst_in6->sin6_port);
+    }
+    else if (src.ss_family == AF_UNIX && dst.ss_family == AF_UNIX)
+    {
+        pp_info->address_family = ADDR_FAMILY_UNIX;
+        sun_path_copy((uint8_t*) pp_info->src_addr, (const struct sockaddr_un*) &src);
+        sun_path_copy((uint8_t*) pp_info->dst_addr, (const struct sockaddr_un*) &dst);
+        pp_info->src_port = 0;
+        pp_info->dst_port = 0;
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (type == SOCK_STREAM)
+    {
+        pp_info->transport_protocol = TRANSPORT_PROTOCOL_STREAM;
+    }
+    else if (type == SOCK_DGRAM)
+    {
+        pp_info->transport_protocol = TRANSPORT_PROTOCOL_DGRAM;
+    }
+    else
+    {
+        pp_info->transport_protocol = TRANSPORT_PROTOCOL_UNSPEC;
+    }
+    return 1;
+}
+
+void pp_builder_init(pp_builder_t *builder)
+{
+    memset(builder, 0, sizeof(*builder));
+}
+
+const uint8_t *pp_builder_create_hdr(pp_builder_t *builder, uint8_t version, uint16_t *pp_hdr_len, int32_t *error)
+{
+    if (version == 2)
+    {
+        proxy_addr_t proxy_addr;
+        uint16_t proxy_addr_len;
+        *error = pp2_addr_from_pp_info(&builder->pp_info, &proxy_addr, &proxy_addr_len);
+        if (*error != ERR_NULL
+            || !pp2_hdr_write(NULL, &builder->pp_info, builder->pp_info.address_family, &proxy_addr, proxy_addr_len, builder->tlvs, builder->tlvs_len, &builder->hdr, &builder->hdr_size, pp_hdr_len, NULL, error))
         {
-            *error = -ERR_PP2_IPV4_SRC_IP;
             return NULL;
         }
-        if (inet_pton(AF_INET, pp_info->dst_addr, &proxy_addr.ipv4_addr.dst_addr) != 1)
+    }
+    else if (version == 1)
+    {
+        if (!pp1_hdr_write(NULL, &builder->pp_info, &builder->hdr, &builder->hdr_size, pp_hdr_len, error))
         {
-            *error = -ERR_PP2_IPV4_DST_IP;
             return NULL;
         }
-        proxy_addr.ipv4_addr.src_port = htons(pp_info->src_port);
-        proxy_addr.ipv4_addr.dst_port = htons(pp_info->dst_port);
     }
-    else if (pp_info->address_family == ADDR_FAMILY_INET6)
+    else
+    {
+        *error = -ERR_PP_VERSION;
+        return NULL;
+    }
+    return builder->hdr;
+}
+
+const uint8_t *pp_builder_create_hdr_from_sockaddr(pp_builder_t *builder, uint8_t version, const struct sockaddr *src, const struct sockaddr *dst,
+                                                   uint16_t *pp_hdr_len, int32_t *error)
+{
+    if (!pp_hdr_write_sockaddr(version, &builder->pp_info, builder->tlvs, builder->tlvs_len, src, dst, &builder->hdr, &builder->hdr_size, pp_hdr_len, error))
+    {
+        return NULL;
+    }
+    return builder->hdr;
+}
+
+void pp_builder_reset(pp_builder_t *builder)
+{
+    /* TLVs added to pp_info directly through pp_info_add_*() do not have a retained storage */
+    pp_info_clear(&builder->pp_info);
+    builder->tlvs_len = 0;
+}
+
+void pp_builder_free(pp_builder_t *builder)
+{
+    pp_info_clear(&builder->pp_info);
+    free(builder->tlvs);
+    free(builder->hdr);
+    memset(builder, 0, sizeof(*builder));
+}
+
+/* Length of the address block of a v2 address family. Returns -1 for an unknown one */
+static int32_t pp2_addr_len(uint8_t address_family)
+{
+    switch (address_family)
+    {
+    case ADDR_FAMILY_UNSPEC:
+        return 0;
+    case ADDR_FAMILY_INET:
+        return sizeof(((proxy_addr_t*) NULL)->ipv4_addr);
+    case ADDR_FAMILY_INET6:
+        return sizeof(((proxy_addr_t*) NULL)->ipv6_addr);
+    case ADDR_FAMILY_UNIX:
+        return sizeof(((proxy_addr_t*) NULL)->unix_addr);
+    default:
+        return -1;
+    }
+}
+
+/* Locates the TLV region of a v2 header by its framing alone (signature, version, family and length).
+ * Neither addresses nor TLVs are decoded
+ *
+ * return   > 0 Length of the whole v2 header. *tlvs and *tlvs_len are set
+ *          < 0 Error
+ */
+static int32_t pp2_hdr_locate_tlvs(const uint8_t *buffer, uint32_t buffer_length, const uint8_t **tlvs, uint16_t *tlvs_len)
+{
+    if (buffer_length < sizeof(proxy_hdr_v2_t) || memcmp(buffer, PP2_SIG, 12))
+    {
+        return -ERR_PP2_SIG;
+    }
+    const proxy_hdr_v2_t *proxy_hdr_v2 = (const proxy_hdr_v2_t*) buffer;
+    if (proxy_hdr_v2->ver_cmd >> 4 != 0x2)
+    {
+        return -ERR_PP2_VERSION;
+    }
+    int32_t addr_len = pp2_addr_len(proxy_hdr_v2->fam >> 4);
+    if (addr_len < 0)
+    {
+        return -ERR_PP2_ADDR_FAMILY;
+    }
+    uint16_t len = ntohs(proxy_hdr_v2->len);
+    if (buffer_length < sizeof(proxy_hdr_v2_t) + len || len < addr_len)
+    {
+        return -ERR_PP2_LENGTH;
+    }
+    *tlvs = buffer + sizeof(proxy_hdr_v2_t) + addr_len;
+    *tlvs_len = len - addr_len;
+    return sizeof(proxy_hdr_v2_t) + len;
+}
+
+int32_t pp2_get_unix_addrs(const uint8_t *hdr, uint32_t len, const uint8_t **src, uint16_t *src_len, const uint8_t **dst, uint16_t *dst_len)
+{
+    const uint8_t *tlvs;
+    uint16_t tlvs_len;
+    int32_t pp2_hdr_len = pp2_hdr_locate_tlvs(hdr, len, &tlvs, &tlvs_len);
+    if (pp2_hdr_len < 0)
+    {
+        return pp2_hdr_len;
+    }
+    if (((const proxy_hdr_v2_t*) hdr)->fam >> 4 != ADDR_FAMILY_UNIX)
+    {
+        return -ERR_PP2_ADDR_FAMILY;
+    }
+    const proxy_addr_t *addr = (const proxy_addr_t*) (hdr + sizeof(proxy_hdr_v2_t));
+    *src = addr->unix_addr.src_addr;
+    *src_len = unix_path_len(addr->unix_addr.src_addr, sizeof(addr->unix_addr.src_addr));
+    *dst = addr->unix_addr.dst_addr;
+    *dst_len = unix_path_len(addr->unix_addr.dst_addr, sizeof(addr->unix_addr.dst_addr));
+    return pp2_hdr_len;
+}
+
+/* The TLV framing rule shared by every path walking TLVs, so that they all accept and reject the same bytes:
+ * a TLV must fit in what is left while fewer bytes than a TLV header at the end are ignored
+ *
+ * return   > 0 Length of the TLV at tlv, header included
+ *          == 0 No more TLVs
+ *          < 0 -ERR_PP2_TLV_LENGTH
+ */
+static int32_t pp2_tlv_framed_len(const uint8_t *tlv, uint32_t remaining)
+{
+    if (remaining < sizeof_pp2_tlv_t)
+    {
+        return 0;
+    }
+    uint32_t tlv_len = sizeof_pp2_tlv_t + (((const pp2_tlv_t*) tlv)->length_hi << 8 | ((const pp2_tlv_t*) tlv)->length_lo);
+    if (tlv_len > remaining)
+    {
+        return -ERR_PP2_TLV_LENGTH;
+    }
+    return tlv_len;
+}
+
+static void pp_tlv_iter_init_region(pp_tlv_iter_t *iter, const uint8_t *tlvs, uint32_t tlvs_len)
+{
+    memset(iter, 0, sizeof(*iter));
+    iter->next = tlvs;
+    iter->end = tlvs + tlvs_len;
+}
+
+int32_t pp_tlv_iter_init(pp_tlv_iter_t *iter, const uint8_t *buffer, uint32_t buffer_length)
+{
+    const uint8_t *tlvs = NULL;
+    uint16_t tlvs_len = 0;
+    int32_t rc = pp2_hdr_locate_tlvs(buffer, buffer_length, &tlvs, &tlvs_len);
+    pp_tlv_iter_init_region(iter, tlvs, tlvs_len);
+    if (rc < 0)
+    {
+        iter->error = rc;
+        iter->end = iter->next;
+    }
+    return rc;
+}
+
+int32_t pp_tlv_iter_init_ssl(pp_tlv_iter_t *sub_iter, const pp_tlv_iter_t *iter)
+{
+    /* Skip <client> and <verify> */
+    if (iter->type != PP2_TYPE_SSL || iter->length < sizeof(uint8_t) + sizeof(uint32_t))
+    {
+        pp_tlv_iter_init_region(sub_iter, NULL, 0);
+        sub_iter->error = -ERR_PP2_TYPE_SSL;
+        return sub_iter->error;
+    }
+    pp_tlv_iter_init_region(sub_iter, iter->value + sizeof(uint8_t) + sizeof(uint32_t), iter->length - sizeof(uint8_t) - sizeof(uint32_t));
+    return ERR_NULL;
+}
+
+uint8_t pp_tlv_iter_next(pp_tlv_iter_t *iter)
+{
+    int32_t tlv_len = pp2_tlv_framed_len(iter->next, iter->end - iter->next);
+    if (tlv_len <= 0)
+    {
+        iter->error = tlv_len;
+        iter->next = iter->end;
+        return 0;
+    }
+    const pp2_tlv_t *tlv = (const pp2_tlv_t*) iter->next;
+    iter->type = tlv->type;
+    iter->length = tlv_len - sizeof_pp2_tlv_t;
+    iter->value = tlv->value;
+    iter->tlv = iter->next;
+    iter->next += tlv_len;
+    return 1;
+}
+
+/* CRC32c of a whole v2 header whose checksum value sits at crc32c_offset. The checksum field counts as zero;
+ * the buffer itself is left untouched so that read only headers (e.g. pp2_get_healthcheck_hdr()) can be verified
+ */
+static uint32_t pp2_hdr_crc32c(const uint8_t *pp2_hdr, uint32_t pp2_hdr_len, uint32_t crc32c_offset, uint8_t engine)
+{
+    static const uint8_t zeros[sizeof(uint32_t)] = { 0 };
+    uint32_t crc32c_calculated = crc32c_update_engine(engine, 0xffffffff, pp2_hdr, crc32c_offset);
+    crc32c_calculated = crc32c_update_table(crc32c_calculated, zeros, sizeof(zeros));
+    crc32c_calculated = crc32c_update_engine(engine, crc32c_calculated, pp2_hdr + crc32c_offset + sizeof(uint32_t),
+                                             pp2_hdr_len - crc32c_offset - sizeof(uint32_t));
+    return crc32c_calculated ^ 0xffffffff;
+}
+
+static uint8_t pp2_hdr_crc32c_matches(const uint8_t *pp2_hdr, uint32_t pp2_hdr_len, uint32_t crc32c_offset, uint8_t engine)
+{
+    return pp2_hdr_crc32c(pp2_hdr, pp2_hdr_len, crc32c_offset, engine) == crc32c_load(pp2_hdr + crc32c_offset);
+}
+
+static uint8_t pp2_forward_strips(const uint8_t *strip_types, uint8_t type)
+{
+    /* A forwarded header's CRC32c is always either recalculated or dropped */
+    return type == PP2_TYPE_CRC32C || (strip_types && PP_TLV_TYPE_MASK_ISSET(strip_types, type));
+}
+
+int32_t pp2_forward_hdr(const uint8_t *hdr, uint32_t hdr_length, const uint8_t *strip_types, const uint8_t *append_tlvs, uint16_t append_tlvs_len,
+                        uint8_t flags, uint8_t *out, uint32_t out_size)
+{
+    const uint8_t *tlvs = NULL;
+    uint16_t tlvs_len = 0;
+    int32_t rc = pp2_hdr_locate_tlvs(hdr, hdr_length, &tlvs, &tlvs_len);
+    if (rc < 0)
+    {
+        return rc;
+    }
+
+    /* Walk the TLV headers only, to validate them, find the forwarded length and the received checksum */
+    uint16_t addr_end = tlvs - hdr;
+    uint32_t hdr_len = addr_end + append_tlvs_len;
+    uint32_t crc32c_offset = 0;
+    pp_tlv_iter_t iter;
+    pp_tlv_iter_init_region(&iter, tlvs, tlvs_len);
+    while (pp_tlv_iter_next(&iter))
+    {
+        if (iter.type == PP2_TYPE_CRC32C)
+        {
+            if (iter.length != sizeof(uint32_t) || crc32c_offset)
+            {
+                return -ERR_PP2_TYPE_CRC32C;
+            }
+            crc32c_offset = iter.value - hdr;
+        }
+        if (!pp2_forward_strips(strip_types, iter.type))
+        {
+            hdr_len += sizeof_pp2_tlv_t + iter.length;
+        }
+    }
+    if (iter.error != ERR_NULL)
+    {
+        return iter.error;
+    }
+    /* Before anything is written: out may be hdr itself */
+    if (crc32c_offset && !(flags & PP2_FORWARD_F_CRC32C_SKIP)
+        && !pp2_hdr_crc32c_matches(hdr, rc, crc32c_offset, PP_CRC32C_ENGINE_AUTO))
+    {
+        return -ERR_PP2_TYPE_CRC32C;
+    }
+    uint8_t crc32c = flags & PP2_FORWARD_F_CRC32C;
+    pp_tlv_iter_init_region(&iter, append_tlvs, append_tlvs_len);
+    while (pp_tlv_iter_next(&iter));
+    if (iter.error != ERR_NULL)
+    {
+        return iter.error;
+    }
+    if (crc32c)
+    {
+        hdr_len += sizeof_pp2_tlv_t + sizeof(uint32_t);
+    }
+    if (hdr_len > UINT16_MAX || hdr_len > out_size)
+    {
+        return -ERR_PP2_LENGTH;
+    }
+
+    /* Single copy pass. Stripping only ever moves bytes backwards so out may be hdr itself */
+    crc32c_running_t crc32c_running = { 0xffffffff, PP_CRC32C_ENGINE_AUTO };
+    crc32c_running_t *crc = crc32c ? &crc32c_running : NULL;
+    uint16_t index = 0;
+    proxy_hdr_v2_t proxy_hdr_v2;
+    memcpy(&proxy_hdr_v2, hdr, sizeof(proxy_hdr_v2_t));
+    proxy_hdr_v2.len = htons(hdr_len - sizeof(proxy_hdr_v2_t));
+    pp2_hdr_emit(out, &index, &proxy_hdr_v2, sizeof(proxy_hdr_v2_t), crc);
+    pp2_hdr_emit(out, &index, hdr + sizeof(proxy_hdr_v2_t), addr_end - sizeof(proxy_hdr_v2_t), crc);
+    pp_tlv_iter_init_region(&iter, tlvs, tlvs_len);
+    while (pp_tlv_iter_next(&iter))
+    {
+        if (!pp2_forward_strips(strip_types, iter.type))
+        {
+            pp2_hdr_emit(out, &index, iter.tlv, sizeof_pp2_tlv_t + iter.length, crc);
+        }
+    }
+    if (append_tlvs_len)
+    {
+        pp2_hdr_emit(out, &index, append_tlvs, append_tlvs_len, crc);
+    }
+    if (crc32c)
+    {
+        pp2_tlv_t tlv = { .type = PP2_TYPE_CRC32C, .length_lo = sizeof(uint32_t) };
+        pp2_hdr_emit(out, &index, &tlv, sizeof_pp2_tlv_t, crc);
+        uint16_t crc32c_index = index;
+        pp2_hdr_emit(out, &index, NULL, sizeof(uint32_t), crc);
+        crc32c_store(out + crc32c_index, crc32c_running.value ^ 0xffffffff);
+    }
+    return hdr_len;
+}
+
+uint16_t pp2_tlv_write(uint8_t *out, uint32_t out_size, uint8_t type, uint16_t length, const uint8_t *value)
+{
+    if (out_size < sizeof_pp2_tlv_t + (uint32_t) length)
+    {
+        return 0;
+    }
+    pp2_tlv_t *tlv = (pp2_tlv_t*) out;
+    tlv->type = type;
+    tlv->length_hi = length >> 8;
+    tlv->length_lo = length & 0x00ff;
+    memcpy(tlv->value, value, length);
+    return sizeof_pp2_tlv_t + length;
+}
+
+int32_t pp_info_verify_crc32c(pp_info_t *pp_info, const uint8_t *buffer, uint32_t buffer_length)
+{
+    if (pp_info->pp2_info.crc32c < 2)
+    {
+        return ERR_NULL;
+    }
+    const uint8_t *tlvs;
+    uint16_t tlvs_len;
+    int32_t pp2_hdr_len = pp2_hdr_locate_tlvs(buffer, buffer_length, &tlvs, &tlvs_len);
+    if (pp2_hdr_len < 0)
+    {
+        return pp2_hdr_len;
+    }
+    if (pp_info->pp2_info.crc32c_offset + sizeof(uint32_t) > (uint32_t) pp2_hdr_len)
+    {
+        return -ERR_PP2_LENGTH;
+    }
+    const pp_ctx_t *ctx = pp_info->pp2_info.tlv_array.ctx;
+    if (!pp2_hdr_crc32c_matches(buffer, pp2_hdr_len, pp_info->pp2_info.crc32c_offset, ctx ? ctx->crc32c_engine : PP_CRC32C_ENGINE_AUTO))
+    {
+        return -ERR_PP2_TYPE_CRC32C;
+    }
+    pp_info->pp2_info.crc32c = 1;
+    return ERR_NULL;
+}
+
+/* Finds the PP2_TYPE_CRC32C TLV among the header's TLVs. A malformed or a repeated one is an error, as in pp_parse_hdr()
+ *
+ * return   1: found and its value's offset within hdr is in crc32c_offset 0: none < 0: error
+ */
+static int32_t pp2_hdr_find_crc32c(const uint8_t *hdr, const uint8_t *tlvs, uint16_t tlvs_len, uint32_t *crc32c_offset)
+{
+    pp_tlv_iter_t iter;
+    *crc32c_offset = 0;
+    pp_tlv_iter_init_region(&iter, tlvs, tlvs_len);
+    while (pp_tlv_iter_next(&iter))
     {
-        proxy_addr_len = 36;
-        if (inet_pton(AF_INET6, pp_info->src_addr, &proxy_addr.ipv6_addr.src_addr) != 1)
+        if (iter.type != PP2_TYPE_CRC32C)
         {
-            *error = -ERR_PP2_IPV6_SRC_IP;
-            return NULL;
+            continue;
         }
-        if (inet_pton(AF_INET6, pp_info->dst_addr, &proxy_addr.ipv6_addr.dst_addr) != 1)
+        if (iter.length != sizeof(uint32_t) || *crc32c_offset)
         {
-            *error = -ERR_PP2_IPV6_DST_IP;
-            return NULL;
+            return -ERR_PP2_TYPE_CRC32C;
         }
-        proxy_addr.ipv6_addr.src_port = htons(pp_info->src_port);
-        proxy_addr.ipv6_addr.dst_port = htons(pp_info->dst_port);
+        *crc32c_offset = iter.value - hdr;
     }
-    else if (pp_info->address_family == ADDR_FAMILY_UNIX)
+    if (iter.error != ERR_NULL)
     {
-        proxy_addr_len = 216;
-        memcpy(proxy_addr.unix_addr.src_addr, pp_info->src_addr, sizeof(pp_info->src_addr));
-        memcpy(proxy_addr.unix_addr.dst_addr, pp_info->dst_addr, sizeof(pp_info->dst_addr));
+        return iter.error;
     }
-    else
+    return *crc32c_offset != 0;
+}
+
+int32_t pp2_verify_crc32c(const uint8_t *hdr, uint32_t len)
+{
+    const uint8_t *tlvs;
+    uint16_t tlvs_len;
+    int32_t pp2_hdr_len = pp2_hdr_locate_tlvs(hdr, len, &tlvs, &tlvs_len);
+    if (pp2_hdr_len < 0)
     {
-        *error = -ERR_PP2_ADDR_FAMILY;
-        return NULL;
+        return pp2_hdr_len;
     }
 
-    if (pp_info->transport_protocol > TRANSPORT_PROTOCOL_DGRAM)
+    uint32_t crc32c_offset;
+    int32_t rc = pp2_hdr_find_crc32c(hdr, tlvs, tlvs_len, &crc32c_offset);
+    if (rc <= 0)
     {
-        *error = -ERR_PP2_TRANSPORT_PROTOCOL;
-        return NULL;
+        return rc;
+    }
+    if (!pp2_hdr_crc32c_matches(hdr, pp2_hdr_len, crc32c_offset, PP_CRC32C_ENGINE_AUTO))
+    {
+        return -ERR_PP2_TYPE_CRC32C;
     }
+    return pp2_hdr_len;
+}
 
-    proxy_hdr_v2.fam = pp_info->address_family << 4 | pp_info->transport_protocol;
+#define PP2_CRC32C_BATCH 64
 
-    /* Calculate the total length */
-    uint16_t len = proxy_addr_len;
-    const tlv_array_t *tlv_array = &pp_info->pp2_info.tlv_array;
-    uint16_t padding_bytes = 0;
+/* Headers whose checksums are calculated together. index is the header's position in the caller's arrays */
+typedef struct
+{
+    const uint8_t *hdr[PP2_CRC32C_BATCH];
+    uint32_t       hdr_len[PP2_CRC32C_BATCH];
+    uint32_t       crc32c_offset[PP2_CRC32C_BATCH];
+    uint32_t       index[PP2_CRC32C_BATCH];
+    uint32_t       crc32c[PP2_CRC32C_BATCH];
+    uint32_t       count;
+    uint8_t        engine; /* PP_CRC32C_ENGINE_* */
+} pp2_crc32c_batch_t;
+
+static void pp2_crc32c_batch_add(pp2_crc32c_batch_t *batch, const uint8_t *pp2_hdr, uint32_t pp2_hdr_len, uint32_t crc32c_offset, uint32_t index)
+{
+    batch->hdr[batch->count] = pp2_hdr;
+    batch->hdr_len[batch->count] = pp2_hdr_len;
+    batch->crc32c_offset[batch->count] = crc32c_offset;
+    batch->index[batch->count] = index;
+    batch->count++;
+}
+
+/* Same as pp2_hdr_crc32c() for all the batched headers, their streams interleaved by crc32c_update_batch() */
+static void pp2_crc32c_batch_flush(pp2_crc32c_batch_t *batch)
+{
+    static const uint8_t zeros[sizeof(uint32_t)] = { 0 };
+    const uint8_t *buf[PP2_CRC32C_BATCH];
+    uint32_t len[PP2_CRC32C_BATCH];
     uint32_t i;
-    for (i = 0; i < tlv_array->len; i++)
+    for (i = 0; i < batch->count; i++)
     {
-        uint16_t tlv_len = sizeof_pp2_tlv_t + (tlv_array->tlvs[i]->length_hi << 8 | tlv_array->tlvs[i]->length_lo);
-        len += tlv_len;
+        batch->crc32c[i] = 0xffffffff;
+        buf[i] = batch->hdr[i];
+        len[i] = batch->crc32c_offset[i];
     }
-    if (pp_info->pp2_info.crc32c)
+    crc32c_update_batch(batch->engine, batch->crc32c, buf, len, batch->count);
+    for (i = 0; i < batch->count; i++)
     {
-        len += sizeof_pp2_tlv_t + sizeof(uint32_t);
+        batch->crc32c[i] = crc32c_update_table(batch->crc32c[i], zeros, sizeof(zeros));
+        buf[i] = batch->hdr[i] + batch->crc32c_offset[i] + sizeof(uint32_t);
+        len[i] = batch->hdr_len[i] - batch->crc32c_offset[i] - sizeof(uint32_t);
     }
-    *pp2_hdr_len = sizeof(proxy_hdr_v2_t) + len;
-    if (pp_info->pp2_info.alignment_power > 1)
+    crc32c_update_batch(batch->engine, batch->crc32c, buf, len, batch->count);
+    for (i = 0; i < batch->count; i++)
     {
-        uint16_t alignment = 1 << pp_info->pp2_info.alignment_power;
-        if (*pp2_hdr_len % alignment)
+        batch->crc32c[i] ^= 0xffffffff;
+    }
+}
+
+static uint8_t pp2_crc32c_batch_matches(const pp2_crc32c_batch_t *batch, uint32_t i)
+{
+    return batch->crc32c[i] == crc32c_load(batch->hdr[i] + batch->crc32c_offset[i]);
+}
+
+/* Turns the batched verify results into their final values once the checksums are calculated */
+static uint32_t pp2_verify_crc32c_batch_flush(pp2_crc32c_batch_t *batch, int32_t *results)
+{
+    uint32_t verified = 0;
+    uint32_t i;
+    pp2_crc32c_batch_flush(batch);
+    for (i = 0; i < batch->count; i++)
+    {
+        if (pp2_crc32c_batch_matches(batch, i))
         {
-            uint16_t pp2_hdr_len_padded = (*pp2_hdr_len / alignment + 1) * alignment;
-            /* The NOOP TLV needs to be at least 3 bytes because a TLV can not be smaller than that */
-            if (pp2_hdr_len_padded - *pp2_hdr_len < sizeof_pp2_tlv_t)
+            verified++;
+        }
+        else
+        {
+            results[batch->index[i]] = -ERR_PP2_TYPE_CRC32C;
+        }
+    }
+    batch->count = 0;
+    return verified;
+}
+
+uint32_t pp2_verify_crc32c_batch(const uint8_t *const *hdrs, const uint32_t *lens, uint32_t count, int32_t *results)
+{
+    pp2_crc32c_batch_t batch;
+    uint32_t verified = 0;
+    uint32_t i;
+    batch.count = 0;
+    batch.engine = PP_CRC32C_ENGINE_AUTO;
+    for (i = 0; i < count; i++)
+    {
+        const uint8_t *tlvs;
+        uint16_t tlvs_len;
+        results[i] = pp2_hdr_locate_tlvs(hdrs[i], lens[i], &tlvs, &tlvs_len);
+        if (results[i] < 0)
+        {
+            continue;
+        }
+
+        uint32_t crc32c_offset;
+        int32_t rc = pp2_hdr_find_crc32c(hdrs[i], tlvs, tlvs_len, &crc32c_offset);
+        if (rc <= 0)
+        {
+            results[i] = rc;
+        }
+        else
+        {
+            pp2_crc32c_batch_add(&batch, hdrs[i], results[i], crc32c_offset, i);
+            if (batch.count == PP2_CRC32C_BATCH)
             {
-                pp2_hdr_len_padded += alignment;
+                verified += pp2_verify_crc32c_batch_flush(&batch, results);
             }
-            padding_bytes = pp2_hdr_len_padded - sizeof(proxy_hdr_v2_t) - len - sizeof_pp2_tlv_t;
-
-            *pp2_hdr_len = pp2_hdr_len_padded;
-            len = pp2_hdr_len_padded - sizeof(proxy_hdr_v2_t);
         }
     }
-    proxy_hdr_v2.len = htons(len);
+    verified += pp2_verify_crc32c_batch_flush(&batch, results);
+    return verified;
+}
 
-    /* Create the PROXY protocol header */
-    uint8_t *pp2_hdr = malloc(*pp2_hdr_len);
-    if (!pp2_hdr)
+/* Fills in the checksums the batched headers were created with zeroed */
+static void pp2_create_hdr_batch_flush(pp2_crc32c_batch_t *batch, uint8_t **pp2_hdrs)
+{
+    uint32_t i;
+    pp2_crc32c_batch_flush(batch);
+    for (i = 0; i < batch->count; i++)
     {
-        *error = -ERR_HEAP_ALLOC;
-        return NULL;
+        crc32c_store(pp2_hdrs[batch->index[i]] + batch->crc32c_offset[i], batch->crc32c[i]);
     }
-    uint16_t index = 0;
-    memcpy(pp2_hdr, &proxy_hdr_v2, sizeof(proxy_hdr_v2_t));
-    index += sizeof(proxy_hdr_v2_t);
-    memcpy(pp2_hdr + index, &proxy_addr, proxy_addr_len);
-    index += proxy_addr_len;
+    batch->count = 0;
+}
 
-    /* Append the TLVs */
-    for (i = 0; i < tlv_array->len; i++)
+uint32_t pp2_create_hdr_batch(pp_ctx_t *ctx, const pp_info_t *pp_infos, uint32_t count, uint8_t **pp2_hdrs, uint16_t *pp2_hdr_lens, int32_t *results)
+{
+    pp2_crc32c_batch_t batch;
+    uint32_t created = 0;
+    uint32_t i;
+    batch.count = 0;
+    batch.engine = ctx ? ctx->crc32c_engine : PP_CRC32C_ENGINE_AUTO;
+    for (i = 0; i < count; i++)
+    {
+        uint32_t crc32c_offset;
+        pp2_hdrs[i] = pp2_create_hdr(ctx, &pp_infos[i], &pp2_hdr_lens[i], &crc32c_offset, &results[i]);
+        pp_ctx_count_create(ctx, pp2_hdrs[i], &results[i]);
+        if (!pp2_hdrs[i])
+        {
+            continue;
+        }
+        created++;
+        if (crc32c_offset)
+        {
+            pp2_crc32c_batch_add(&batch, pp2_hdrs[i], pp2_hdr_lens[i], crc32c_offset, i);
+            if (batch.count == PP2_CRC32C_BATCH)
+            {
+                pp2_create_hdr_batch_flush(&batch, pp2_hdrs);
+            }
+        }
+    }
+    pp2_create_hdr_batch_flush(&batch, pp2_hdrs);
+    return created;
+}
+
+/* Parsers of the TLV types the library knows. They validate the TLV and keep what pp_info_get_*() expose.
+ * return ERR_NULL or < 0 on error
+ */
+typedef int32_t (*pp2_tlv_parser_t)(const pp2_tlv_t *pp2_tlv, uint16_t pp2_tlv_len, const uint8_t *pp2_hdr, pp_info_t *pp_info);
+
+/* Byte sequence, UTF8 */
+static int32_t pp2_parse_tlv_bytes(const pp2_tlv_t *pp2_tlv, uint16_t pp2_tlv_len, const uint8_t *pp2_hdr, pp_info_t *pp_info)
+{
+    (void) pp2_hdr;
+    if (!tlv_array_append_tlv_new(&pp_info->pp2_info.tlv_array, pp2_tlv->type, pp2_tlv_len, pp2_tlv->value))
     {
-        uint16_t tlv_len = sizeof_pp2_tlv_t + (tlv_array->tlvs[i]->length_hi << 8 | tlv_array->tlvs[i]->length_lo);
-        memcpy(pp2_hdr + index, tlv_array->tlvs[i], tlv_len);
-        index += tlv_len;
+        return -ERR_HEAP_ALLOC;
     }
-    if (pp_info->pp2_info.alignment_power > 1)
+    return ERR_NULL;
+}
+
+/* US-ASCII */
+static int32_t pp2_parse_tlv_usascii(const pp2_tlv_t *pp2_tlv, uint16_t pp2_tlv_len, const uint8_t *pp2_hdr, pp_info_t *pp_info)
+{
+    (void) pp2_hdr;
+    if (!tlv_array_append_tlv_new_usascii(&pp_info->pp2_info.tlv_array, pp2_tlv->type, pp2_tlv_len, pp2_tlv->value))
     {
-        pp2_tlv_t tlv = {
-            .type = PP2_TYPE_NOOP,
-            .length_hi = padding_bytes >> 8,
-            .length_lo = padding_bytes & 0x00ff
-        };
-        memcpy(pp2_hdr + index, &tlv, sizeof_pp2_tlv_t);
-        index += sizeof_pp2_tlv_t;
-        memset(pp2_hdr + index, 0, padding_bytes);
-        index += padding_bytes;
+        return -ERR_HEAP_ALLOC;
     }
-    if (pp_info->pp2_info.crc32c)
+    return ERR_NULL;
+}
+
+/* 32-bit number */
+static int32_t pp2_parse_tlv_crc32c(const pp2_tlv_t *pp2_tlv, uint16_t pp2_tlv_len, const uint8_t *pp2_hdr, pp_info_t *pp_info)
+{
+    /* A second checksum would be covered by the first one as plain data and never verified itself */
+    if (pp2_tlv_len != sizeof(uint32_t) || pp_info->pp2_info.crc32c)
     {
-        pp2_tlv_t tlv = { .type = PP2_TYPE_CRC32C, .length_lo = sizeof(uint32_t) };
-        memcpy(pp2_hdr + index, &tlv, sizeof_pp2_tlv_t);
-        index += sizeof_pp2_tlv_t;
-        memset(pp2_hdr + index, 0, sizeof(uint32_t));
-        uint32_t crc32c_calculated = crc32c(pp2_hdr, *pp2_hdr_len);
-        memcpy(pp2_hdr + index, &crc32c_calculated, sizeof(uint32_t));
+        return -ERR_PP2_TYPE_CRC32C;
     }
 
-    *error = ERR_NULL;
-    return pp2_hdr;
+    /* Only recorded here. The checksum is verified in one pass once all the TLVs are known to be well formed */
+    if (!tlv_array_append_tlv_new(&pp_info->pp2_info.tlv_array, pp2_tlv->type, pp2_tlv_len, pp2_tlv->value))
+    {
+        return -ERR_HEAP_ALLOC;
+    }
+    pp_info->pp2_info.crc32c = 2;
+    pp_info->pp2_info.crc32c_offset = pp2_tlv->value - pp2_hdr;
+    return ERR_NULL;
 }
 
-uint8_t *pp2_create_healthcheck_hdr(uint16_t *pp2_hdr_len, int32_t *error)
+/* Byte sequence */
+static int32_t pp2_parse_tlv_unique_id(const pp2_tlv_t *pp2_tlv, uint16_t pp2_tlv_len, const uint8_t *pp2_hdr, pp_info_t *pp_info)
 {
-    pp_info_t pp_info = {
-        .address_family = ADDR_FAMILY_UNSPEC,
-        .transport_protocol = TRANSPORT_PROTOCOL_UNSPEC,
-        .pp2_info.local = 1
-    };
-    return pp2_create_hdr(&pp_info, pp2_hdr_len, error);
+    if (pp2_tlv_len > 128)
+    {
+        return -ERR_PP2_TYPE_UNIQUE_ID;
+    }
+    return pp2_parse_tlv_bytes(pp2_tlv, pp2_tlv_len, pp2_hdr, pp_info);
 }
 
-static uint8_t *pp1_create_hdr(const pp_info_t *pp_info, uint16_t *pp1_hdr_len, int32_t *error)
+static int32_t pp2_parse_tlv_ssl(const pp2_tlv_t *pp2_tlv, uint16_t pp2_tlv_len, const uint8_t *pp2_hdr, pp_info_t *pp_info)
 {
-    if (pp_info->transport_protocol != TRANSPORT_PROTOCOL_UNSPEC && pp_info->transport_protocol != TRANSPORT_PROTOCOL_STREAM)
+    (void) pp2_hdr;
+    if (pp2_tlv_len < sizeof(uint8_t) + sizeof(uint32_t))
     {
-        *error = -ERR_PP1_TRANSPORT_FAMILY;
-        return NULL;
+        return -ERR_PP2_TYPE_SSL;
     }
-
-    char block[PP1_MAX_LENGHT];
-    if (pp_info->address_family == ADDR_FAMILY_UNSPEC)
+    /* A second one would leave the fields below and the view describing different TLVs */
+    if (PP_TLV_TYPE_MASK_ISSET(pp_info->pp2_info.tlv_types, PP2_TYPE_SSL))
     {
-        static const char str[] = "PROXY UNKNOWN"CRLF;
-        *pp1_hdr_len = sizeof(str) - 1;
-        memcpy(block, str, *pp1_hdr_len);
+        return -ERR_PP2_TYPE_SSL;
     }
-    else if (pp_info->address_family == ADDR_FAMILY_INET || pp_info->address_family == ADDR_FAMILY_INET6)
+    pp2_tlv_ssl_t *pp2_tlv_ssl = (pp2_tlv_ssl_t*) pp2_tlv->value;
+    pp2_ssl_view_t *pp2_ssl_view = &pp_info->pp2_info.pp2_ssl_view;
+
+    /* Set the pp2_ssl_info */
+    pp_info->pp2_info.pp2_ssl_info.ssl = !!(pp2_tlv_ssl->client & PP2_CLIENT_SSL);
+    pp_info->pp2_info.pp2_ssl_info.cert_in_connection = !!(pp2_tlv_ssl->client & PP2_CLIENT_CERT_CONN);
+    pp_info->pp2_info.pp2_ssl_info.cert_in_session = !!(pp2_tlv_ssl->client & PP2_CLIENT_CERT_SESS);
+    pp_info->pp2_info.pp2_ssl_info.cert_verified = !pp2_tlv_ssl->verify;
+    pp2_ssl_view->client = pp2_tlv_ssl->client;
+    pp2_ssl_view->verify = ntohl(pp2_tlv_ssl->verify);
+
+    uint16_t pp2_tlvs_ssl_len = pp2_tlv_len - sizeof(pp2_tlv_ssl->client) - sizeof(pp2_tlv_ssl->verify);
+    uint8_t tlv_ssl_version_found = 0;
+    uint16_t pp2_sub_tlv_offset = 0;
+    int32_t pp2_sub_tlv_framed_len;
+    while ((pp2_sub_tlv_framed_len = pp2_tlv_framed_len((uint8_t*) pp2_tlv_ssl->sub_tlv + pp2_sub_tlv_offset, pp2_tlvs_ssl_len - pp2_sub_tlv_offset)) != 0)
     {
-        const char *fam = pp_info->address_family == ADDR_FAMILY_INET ? "TCP4" : "TCP6";
-        if (pp_info->address_family == ADDR_FAMILY_INET)
+        if (pp2_sub_tlv_framed_len < 0)
         {
-            struct in_addr in;
-            if (inet_pton(AF_INET, pp_info->src_addr, &in) != 1)
-            {
-                *error = -ERR_PP1_IPV4_SRC_IP;
-                return NULL;
-            }
-            if (inet_pton(AF_INET, pp_info->dst_addr, &in) != 1)
-            {
-                *error = -ERR_PP1_IPV4_DST_IP;
-                return NULL;
-            }
+            return -ERR_PP2_TYPE_SSL;
         }
-        else if (pp_info->address_family == ADDR_FAMILY_INET6)
+        pp2_tlv_t *pp2_sub_tlv_ssl = (pp2_tlv_t*) ((uint8_t*) pp2_tlv_ssl->sub_tlv + pp2_sub_tlv_offset);
+        uint16_t pp2_sub_tlv_ssl_len = pp2_sub_tlv_framed_len - sizeof_pp2_tlv_t;
+
+        const uint8_t **view_value;
+        uint16_t *view_len;
+        switch (pp2_sub_tlv_ssl->type)
         {
-            struct in6_addr in6;
-            if (inet_pton(AF_INET6, pp_info->src_addr, &in6) != 1)
-            {
-                *error = -ERR_PP1_IPV6_SRC_IP;
-                return NULL;
-            }
-            if (inet_pton(AF_INET6, pp_info->dst_addr, &in6) != 1)
+        case PP2_SUBTYPE_SSL_VERSION: /* US-ASCII */
+            tlv_ssl_version_found = 1;
+            view_value = &pp2_ssl_view->version;
+            view_len = &pp2_ssl_view->version_len;
+            break;
+        case PP2_SUBTYPE_SSL_CIPHER:  /* US-ASCII */
+            view_value = &pp2_ssl_view->cipher;
+            view_len = &pp2_ssl_view->cipher_len;
+            break;
+        case PP2_SUBTYPE_SSL_SIG_ALG: /* US-ASCII */
+            view_value = &pp2_ssl_view->sig_alg;
+            view_len = &pp2_ssl_view->sig_alg_len;
+            break;
+        case PP2_SUBTYPE_SSL_KEY_ALG: /* US-ASCII */
+            view_value = &pp2_ssl_view->key_alg;
+            view_len = &pp2_ssl_view->key_alg_len;
+            break;
+        case PP2_SUBTYPE_SSL_CN:      /* UTF8 */
+            view_value = &pp2_ssl_view->cn;
+            view_len = &pp2_ssl_view->cn_len;
+            break;
+        default:
+            /* Left to pp_tlv_iter_init_ssl() */
+            pp2_ssl_view->unknown++;
+            view_value = NULL;
+            view_len = NULL;
+            break;
+        }
+
+        PP_TLV_TYPE_MASK_SET(pp_info->pp2_info.tlv_types, pp2_sub_tlv_ssl->type);
+        /* Only the first of a repeated sub-TLV is kept, the rest cost nothing */
+        if (view_value && !*view_value)
+        {
+            tlv_array_t *tlv_array = &pp_info->pp2_info.tlv_array;
+            uint8_t appended = pp2_sub_tlv_ssl->type == PP2_SUBTYPE_SSL_CN
+                             ? tlv_array_append_tlv_new(tlv_array, pp2_sub_tlv_ssl->type, pp2_sub_tlv_ssl_len, pp2_sub_tlv_ssl->value)
+                             : tlv_array_append_tlv_new_usascii(tlv_array, pp2_sub_tlv_ssl->type, pp2_sub_tlv_ssl_len, pp2_sub_tlv_ssl->value);
+            if (!appended)
             {
-                *error = -ERR_PP1_IPV6_DST_IP;
-                return NULL;
+                return -ERR_HEAP_ALLOC;
             }
+            *view_value = tlv_array->tlvs[tlv_array->len - 1]->value;
+            *view_len = pp2_sub_tlv_ssl_len;
         }
-        char src_addr[39+1];
-        char dst_addr[39+1];
-        memcpy(src_addr, pp_info->src_addr, sizeof(src_addr));
-        memcpy(dst_addr, pp_info->dst_addr, sizeof(dst_addr));
-        *pp1_hdr_len = _sprintf(block, "PROXY %s %s %s %hu %hu"CRLF, fam, src_addr, dst_addr, pp_info->src_port, pp_info->dst_port);
-    }
-    else
-    {
-        *error = -ERR_PP1_TRANSPORT_FAMILY;
-        return NULL;
+
+        pp2_sub_tlv_offset += sizeof_pp2_tlv_t + pp2_sub_tlv_ssl_len;
     }
-    
-    /* Create the PROXY protocol header */
-    uint8_t *pp1_hdr = malloc(*pp1_hdr_len);
-    if (!pp1_hdr)
+    if (pp_info->pp2_info.pp2_ssl_info.ssl && !tlv_ssl_version_found)
     {
-        *error = -ERR_HEAP_ALLOC;
-        return NULL;
+        return -ERR_PP2_TYPE_SSL;
     }
-    memcpy(pp1_hdr, block, *pp1_hdr_len);
-    *error = ERR_NULL;
-    return pp1_hdr;
+    return ERR_NULL;
 }
 
-uint8_t *pp_create_hdr(uint8_t version, const pp_info_t *pp_info, uint16_t *pp_hdr_len, int32_t *error)
+static int32_t pp2_parse_tlv_aws(const pp2_tlv_t *pp2_tlv, uint16_t pp2_tlv_len, const uint8_t *pp2_hdr, pp_info_t *pp_info)
 {
-    if (version == 2)
+    if (pp2_tlv_len < sizeof(pp2_tlv_aws_t))
     {
-        return pp2_create_hdr(pp_info, pp_hdr_len, error);
+        return -ERR_PP2_TYPE_AWS;
     }
-    else if (version == 1)
+    const pp2_tlv_aws_t *pp2_tlv_aws = (const pp2_tlv_aws_t*) pp2_tlv->value;
+    /* Connection is done through Private Link/Interface VPC endpoint */
+    if (pp2_tlv_aws->type == PP2_SUBTYPE_AWS_VPCE_ID) /* US-ASCII */
     {
-        return pp1_create_hdr(pp_info, pp_hdr_len, error);
+        /* Example: \x1vpce-08d2bf15fac5001c9 */
+        return pp2_parse_tlv_usascii(pp2_tlv, pp2_tlv_len, pp2_hdr, pp_info);
     }
-    else
+    return ERR_NULL;
+}
+
+static int32_t pp2_parse_tlv_azure(const pp2_tlv_t *pp2_tlv, uint16_t pp2_tlv_len, const uint8_t *pp2_hdr, pp_info_t *pp_info)
+{
+    if (pp2_tlv_len < sizeof(pp2_tlv_azure_t))
     {
-        *error = -ERR_PP_VERSION;
-        return NULL;
+        return -ERR_PP2_TYPE_AZURE;
+    }
+    const pp2_tlv_azure_t *pp2_tlv_azure = (const pp2_tlv_azure_t*) pp2_tlv->value;
+    /* Connection is done through Private Link service */
+    if (pp2_tlv_azure->type == PP2_SUBTYPE_AZURE_PRIVATEENDPOINT_LINKID) /* 32-bit number */
+    {
+        return pp2_parse_tlv_bytes(pp2_tlv, pp2_tlv_len, pp2_hdr, pp_info);
     }
+    return ERR_NULL;
+}
+
+/* Indexed by the TLV type. NOOP and the types the library does not know have none */
+static const pp2_tlv_parser_t pp2_tlv_parsers[256] = {
+    [PP2_TYPE_ALPN]      = pp2_parse_tlv_bytes,
+    [PP2_TYPE_AUTHORITY] = pp2_parse_tlv_bytes,
+    [PP2_TYPE_CRC32C]    = pp2_parse_tlv_crc32c,
+    [PP2_TYPE_UNIQUE_ID] = pp2_parse_tlv_unique_id,
+    [PP2_TYPE_SSL]       = pp2_parse_tlv_ssl,
+    [PP2_TYPE_NETNS]     = pp2_parse_tlv_usascii,
+    [PP2_TYPE_AWS]       = pp2_parse_tlv_aws,
+    [PP2_TYPE_AZURE]     = pp2_parse_tlv_azure,
+};
+
+/* The types PP_CTX_F_STRICT_TLVS allows only once per header */
+static const uint8_t pp2_tlv_singletons[256] = {
+    [PP2_TYPE_ALPN]      = 1,
+    [PP2_TYPE_AUTHORITY] = 1,
+    [PP2_TYPE_CRC32C]    = 1,
+    [PP2_TYPE_UNIQUE_ID] = 1,
+    [PP2_TYPE_SSL]       = 1,
+    [PP2_TYPE_NETNS]     = 1,
+};
+
+void pp_register_tlv_handler(pp_tlv_handlers_t *handlers, uint8_t type, pp_tlv_handler_t handler, void *user_data)
+{
+    handlers->handlers[type] = handler;
+    handlers->user_data[type] = user_data;
 }
 
 /* Verifies and parses a version 2 PROXY protocol header */
-static int32_t pp2_parse_hdr(uint8_t *buffer, uint32_t buffer_length, pp_info_t *pp_info)
+static int32_t pp2_parse_hdr(uint8_t *buffer, uint32_t buffer_length, pp_info_t *pp_info, uint32_t flags)
 {
     const uint8_t *pp2_hdr = buffer;
     const proxy_hdr_v2_t *proxy_hdr_v2 = (proxy_hdr_v2_t*) buffer;
@@ -943,8 +2788,12 @@ static int32_t pp2_parse_hdr(uint8_t *buffer, uint32_t buffer_length, pp_info_t
     }
     else if (fam == AF_UNIX && len >= sizeof(addr->unix_addr))
     {
-        memcpy(pp_info->src_addr, addr->unix_addr.src_addr, sizeof(addr->unix_addr.src_addr));
-        memcpy(pp_info->dst_addr, addr->unix_addr.dst_addr, sizeof(addr->unix_addr.dst_addr));
+        /* Only the paths themselves. pp_info is zeroed so they stay terminated unless they fill all 108 bytes */
+        memcpy(pp_info->src_addr, addr->unix_addr.src_addr, unix_path_len(addr->unix_addr.src_addr, sizeof(addr->unix_addr.src_addr)));
+        memcpy(pp_info->dst_addr, addr->unix_addr.dst_addr, unix_path_len(addr->unix_addr.dst_addr, sizeof(addr->unix_addr.dst_addr)));
+
+        buffer += sizeof(addr->unix_addr);
+        tlv_vectors_len = len - sizeof(addr->unix_addr);
     }
     else
     {
@@ -952,171 +2801,88 @@ static int32_t pp2_parse_hdr(uint8_t *buffer, uint32_t buffer_length, pp_info_t
     }
 
     /* TLVs */
-    /* Any TLV vector must be at least 3 bytes */
-    while (tlv_vectors_len > sizeof_pp2_tlv_t)
+    const pp_ctx_t *ctx = pp_info->pp2_info.tlv_array.ctx;
+    const pp_tlv_handlers_t *tlv_handlers = ctx ? ctx->tlv_handlers : NULL;
+    uint32_t tlvs_count = 0;
+    int32_t pp2_tlv_offset;
+    while ((pp2_tlv_offset = pp2_tlv_framed_len(buffer, tlv_vectors_len)) != 0)
     {
-        pp2_tlv_t *pp2_tlv = (pp2_tlv_t*) buffer;
-        uint16_t pp2_tlv_len = pp2_tlv->length_hi << 8 | pp2_tlv->length_lo;
-        uint16_t pp2_tlv_offset = sizeof_pp2_tlv_t + pp2_tlv_len;
-        if (pp2_tlv_offset > tlv_vectors_len)
-        {
-            return -ERR_PP2_TLV_LENGTH;
-        }
-
-        switch (pp2_tlv->type)
-        {
-        case PP2_TYPE_ALPN:      /* Byte sequence */
-        case PP2_TYPE_AUTHORITY: /* UTF8 */
-            if (!tlv_array_append_tlv_new(&pp_info->pp2_info.tlv_array, pp2_tlv->type, pp2_tlv_len, pp2_tlv->value))
-            {
-                return -ERR_HEAP_ALLOC;
-            }
-            break;
-        case PP2_TYPE_CRC32C: /* 32-bit number */
-        {
-            if (pp2_tlv_len != sizeof(uint32_t))
-            {
-                return -ERR_PP2_TYPE_CRC32C;
-            }
-
-            /* Received CRC32c checksum */
-            uint32_t crc32c_chksum;
-            memcpy(&crc32c_chksum, pp2_tlv->value, pp2_tlv_len);
-
-            /* Calculate the CRC32c checksum value of the whole PROXY header */
-            memset(pp2_tlv->value, 0, pp2_tlv_len);
-            uint32_t crc32c_calculated = crc32c(pp2_hdr, sizeof(proxy_hdr_v2_t) + len);
-
-            /* Verify that the calculated CRC32c checksum is the same as the received CRC32c checksum*/
-            if (memcmp(&crc32c_chksum, &crc32c_calculated, 4))
-            {
-                return -ERR_PP2_TYPE_CRC32C;
-            }
-
-            if (!tlv_array_append_tlv_new(&pp_info->pp2_info.tlv_array, pp2_tlv->type, pp2_tlv_len, &crc32c_chksum))
-            {
-                return -ERR_HEAP_ALLOC;
-            }
-            pp_info->pp2_info.crc32c = 1;
-            break;
-        }
-        case PP2_TYPE_NOOP:
-            break;
-        case PP2_TYPE_UNIQUE_ID: /* Byte sequence */
-            if (pp2_tlv_len > 128)
-            {
-                return -ERR_PP2_TYPE_UNIQUE_ID;
-            }
-            if (!tlv_array_append_tlv_new(&pp_info->pp2_info.tlv_array, pp2_tlv->type, pp2_tlv_len, pp2_tlv->value))
-            {
-                return -ERR_HEAP_ALLOC;
-            }
-            break;
-        case PP2_TYPE_SSL:
-        {
-            pp2_tlv_ssl_t *pp2_tlv_ssl = (pp2_tlv_ssl_t*) pp2_tlv->value;
-
-            /* Set the pp2_ssl_info */
-            pp_info->pp2_info.pp2_ssl_info.ssl = !!(pp2_tlv_ssl->client & PP2_CLIENT_SSL);
-            pp_info->pp2_info.pp2_ssl_info.cert_in_connection = !!(pp2_tlv_ssl->client & PP2_CLIENT_CERT_CONN);
-            pp_info->pp2_info.pp2_ssl_info.cert_in_session = !!(pp2_tlv_ssl->client & PP2_CLIENT_CERT_SESS);
-            pp_info->pp2_info.pp2_ssl_info.cert_verified = !pp2_tlv_ssl->verify;
-
-            uint16_t pp2_tlvs_ssl_len = pp2_tlv_len - sizeof(pp2_tlv_ssl->client) - sizeof(pp2_tlv_ssl->verify);
-            uint8_t tlv_ssl_version_found = 0;
-            uint16_t pp2_sub_tlv_offset = 0;
-            while (pp2_sub_tlv_offset < pp2_tlvs_ssl_len)
-            {
-                pp2_tlv_t *pp2_sub_tlv_ssl = (pp2_tlv_t*) ((uint8_t*) pp2_tlv_ssl->sub_tlv + pp2_sub_tlv_offset);
-                uint16_t pp2_sub_tlv_ssl_len = pp2_sub_tlv_ssl->length_hi << 8 | pp2_sub_tlv_ssl->length_lo;
-                switch (pp2_sub_tlv_ssl->type)
-                {
-                case PP2_SUBTYPE_SSL_VERSION: /* US-ASCII */
-                    tlv_ssl_version_found = 1;
-                case PP2_SUBTYPE_SSL_CIPHER:  /* US-ASCII */
-                case PP2_SUBTYPE_SSL_SIG_ALG: /* US-ASCII */
-                case PP2_SUBTYPE_SSL_KEY_ALG: /* US-ASCII */
-                    if (!tlv_array_append_tlv_new_usascii(&pp_info->pp2_info.tlv_array, pp2_sub_tlv_ssl->type, pp2_sub_tlv_ssl_len, pp2_sub_tlv_ssl->value))
-                    {
-                        return -ERR_HEAP_ALLOC;
-                    }
-                    break;
-                case PP2_SUBTYPE_SSL_CN: /* UTF8 */
-                    if (!tlv_array_append_tlv_new(&pp_info->pp2_info.tlv_array, pp2_sub_tlv_ssl->type, pp2_sub_tlv_ssl_len, pp2_sub_tlv_ssl->value))
-                    {
-                        return -ERR_HEAP_ALLOC;
-                    }
-                    break;
-                default:
-                    return -ERR_PP2_TYPE_SSL;
-                }
-
-                pp2_sub_tlv_offset += sizeof_pp2_tlv_t + pp2_sub_tlv_ssl_len;
-            }
-            if (pp2_sub_tlv_offset > pp2_tlvs_ssl_len || (pp_info->pp2_info.pp2_ssl_info.ssl && !tlv_ssl_version_found))
-            {
-                return -ERR_PP2_TYPE_SSL;
-            }
-            break;
-        }
-        case PP2_TYPE_NETNS: /* US-ASCII */
-            if (!tlv_array_append_tlv_new_usascii(&pp_info->pp2_info.tlv_array, pp2_tlv->type, pp2_tlv_len, pp2_tlv->value))
-            {
-                return -ERR_HEAP_ALLOC;
-            }
-            break;
-        case PP2_TYPE_AWS:
+        if (pp2_tlv_offset < 0)
         {
-            if (pp2_tlv_len < sizeof(pp2_tlv_aws_t))
-            {
-                return -ERR_PP2_TYPE_AWS;
-            }
-            pp2_tlv_aws_t *pp2_tlv_aws = (pp2_tlv_aws_t*) pp2_tlv->value;
-            /* Connection is done through Private Link/Interface VPC endpoint */
-            if (pp2_tlv_aws->type == PP2_SUBTYPE_AWS_VPCE_ID) /* US-ASCII */
-            {
-                /* Example: \x1vpce-08d2bf15fac5001c9 */
-                if (!tlv_array_append_tlv_new_usascii(&pp_info->pp2_info.tlv_array, pp2_tlv->type, pp2_tlv_len, pp2_tlv->value))
-                {
-                    return -ERR_HEAP_ALLOC;
-                }
-            }
-            break;
+            return pp2_tlv_offset;
         }
-        case PP2_TYPE_AZURE:
+        pp2_tlv_t *pp2_tlv = (pp2_tlv_t*) buffer;
+        uint16_t pp2_tlv_len = pp2_tlv_offset - sizeof_pp2_tlv_t;
+
+        /* Checked before anything is copied so that the allocations stay bounded too */
+        if (flags & PP_CTX_F_STRICT_TLVS)
         {
-            if (pp2_tlv_len < sizeof(pp2_tlv_azure_t))
+            if (++tlvs_count > PP_STRICT_MAX_TLVS)
             {
-                return -ERR_PP2_TYPE_AZURE;
+                return -ERR_PP2_TLV_COUNT;
             }
-            pp2_tlv_azure_t *pp2_tlv_azure = (pp2_tlv_azure_t*) pp2_tlv->value;
-            /* Connection is done through Private Link service */
-            if (pp2_tlv_azure->type == PP2_SUBTYPE_AZURE_PRIVATEENDPOINT_LINKID) /* 32-bit number */
+            if (pp2_tlv_singletons[pp2_tlv->type] && PP_TLV_TYPE_MASK_ISSET(pp_info->pp2_info.tlv_types, pp2_tlv->type))
             {
-                pp2_tlv_t *tlv = tlv_new(pp2_tlv->type, pp2_tlv_len, pp2_tlv->value);
-                if (!tlv || !tlv_array_append_tlv(&pp_info->pp2_info.tlv_array, tlv))
-                {
-                    return -ERR_HEAP_ALLOC;
-                }
+                return -ERR_PP2_TLV_DUPLICATE;
             }
-            break;
         }
-        default:
-            break;
+
+        /* Set once the parser is done so that it can tell a repeated TLV from the first one */
+        pp2_tlv_parser_t pp2_tlv_parser = pp2_tlv_parsers[pp2_tlv->type];
+        int32_t rc;
+        if (pp2_tlv_parser && (rc = pp2_tlv_parser(pp2_tlv, pp2_tlv_len, pp2_hdr, pp_info)) != ERR_NULL)
+        {
+            return rc;
+        }
+        PP_TLV_TYPE_MASK_SET(pp_info->pp2_info.tlv_types, pp2_tlv->type);
+        if (tlv_handlers && tlv_handlers->handlers[pp2_tlv->type]
+            && (rc = tlv_handlers->handlers[pp2_tlv->type](pp2_tlv->type, pp2_tlv->value, pp2_tlv_len, pp_info, tlv_handlers->user_data[pp2_tlv->type])) != ERR_NULL)
+        {
+            return rc;
         }
         buffer += pp2_tlv_offset;
         tlv_vectors_len -= pp2_tlv_offset;
     }
 
+    /* Verify that the calculated CRC32c checksum is the same as the received CRC32c checksum */
+    if (pp_info->pp2_info.crc32c && flags & PP_CTX_F_CRC32C_SKIP)
+    {
+        pp_info->pp2_info.crc32c = 3;
+    }
+    else if (pp_info->pp2_info.crc32c && !(flags & PP_CTX_F_CRC32C_DEFERRED))
+    {
+        if (!pp2_hdr_crc32c_matches(pp2_hdr, sizeof(proxy_hdr_v2_t) + len, pp_info->pp2_info.crc32c_offset,
+                                    flags & PP_F_CRC32C_TABLE ? PP_CRC32C_ENGINE_TABLE : PP_CRC32C_ENGINE_AUTO))
+        {
+            return -ERR_PP2_TYPE_CRC32C;
+        }
+        pp_info->pp2_info.crc32c = 1;
+    }
+
     return sizeof(proxy_hdr_v2_t) + len;
 }
 
-static int32_t pp1_parse_hdr(const uint8_t *buffer, uint32_t buffer_length, pp_info_t *pp_info)
+/* The fields of a v1 line. The addresses come in binary form as inet_pton() produced them and, if wanted, as text too */
+typedef struct
+{
+    uint8_t          address_family;
+    uint8_t          transport_protocol;
+    uint16_t         src_port;
+    uint16_t         dst_port;
+    char            *src_addr;     /* Where the source address text is written NULL terminated. NULL: not wanted */
+    char            *dst_addr;     /* Same for the destination address */
+    struct in6_addr *src_sin_addr;
+    struct in6_addr *dst_sin_addr;
+} pp1_hdr_t;
+
+/* Tokenizes a v1 line straight into the pp1_hdr */
+static int32_t pp1_parse_line(const uint8_t *buffer, uint32_t buffer_length, pp1_hdr_t *pp1_hdr)
 {
     char block[PP1_MAX_LENGHT] = { 0 };
     char *ptr = block;
     int32_t pp1_hdr_len = 0;
-    memcpy(block, buffer, buffer_length < PP1_MAX_LENGHT ? buffer_length : PP1_MAX_LENGHT);
+    /* At most 107 bytes, CRLF included: the last one stays the NUL strstr() stops at */
+    memcpy(block, buffer, buffer_length < PP1_MAX_LENGHT - 1 ? buffer_length : PP1_MAX_LENGHT - 1);
 
     char *block_end = strstr(block, CRLF);
     if (!block_end)
@@ -1147,8 +2913,8 @@ static int32_t pp1_parse_hdr(const uint8_t *buffer, uint32_t buffer_length, pp_i
         /* Unknown connection (short form) */
         if (pp1_hdr_len == 15 || !memcmp(ptr, "UNKNOWN", 7))
         {
-            pp_info->address_family = ADDR_FAMILY_UNSPEC;
-            pp_info->transport_protocol = TRANSPORT_PROTOCOL_UNSPEC;
+            pp1_hdr->address_family = ADDR_FAMILY_UNSPEC;
+            pp1_hdr->transport_protocol = TRANSPORT_PROTOCOL_UNSPEC;
             return pp1_hdr_len;
         }
         return -ERR_PP1_TRANSPORT_FAMILY;
@@ -1157,22 +2923,22 @@ static int32_t pp1_parse_hdr(const uint8_t *buffer, uint32_t buffer_length, pp_i
     if (!memcmp(ptr, "TCP4", 4))
     {
         sa_family = AF_INET;
-        pp_info->address_family = ADDR_FAMILY_INET;
-        pp_info->transport_protocol = TRANSPORT_PROTOCOL_STREAM;
+        pp1_hdr->address_family = ADDR_FAMILY_INET;
+        pp1_hdr->transport_protocol = TRANSPORT_PROTOCOL_STREAM;
         ptr += 4;
     }
     else if (!memcmp(ptr, "TCP6", 4))
     {
         sa_family = AF_INET6;
-        pp_info->address_family = ADDR_FAMILY_INET6;
-        pp_info->transport_protocol = TRANSPORT_PROTOCOL_STREAM;
+        pp1_hdr->address_family = ADDR_FAMILY_INET6;
+        pp1_hdr->transport_protocol = TRANSPORT_PROTOCOL_STREAM;
         ptr += 4;
     }
     else if (!memcmp(ptr, "UNKNOWN", 7))
     {
         /* The receiver must ignore anything presented before the CRLF is found */
-        pp_info->address_family = ADDR_FAMILY_UNSPEC;
-        pp_info->transport_protocol = TRANSPORT_PROTOCOL_UNSPEC;
+        pp1_hdr->address_family = ADDR_FAMILY_UNSPEC;
+        pp1_hdr->transport_protocol = TRANSPORT_PROTOCOL_UNSPEC;
         return pp1_hdr_len;
     }
     else
@@ -1191,45 +2957,36 @@ static int32_t pp1_parse_hdr(const uint8_t *buffer, uint32_t buffer_length, pp_i
     char *src_address_end = strchr(ptr, ' ');
     if (!src_address_end)
     {
-        return sa_family == AF_INET ? ERR_PP1_IPV4_SRC_IP : ERR_PP1_IPV6_SRC_IP;
+        return sa_family == AF_INET ? -ERR_PP1_IPV4_SRC_IP : -ERR_PP1_IPV6_SRC_IP;
     }
-    uint16_t src_address_length = src_address_end - ptr;
-    memcpy(pp_info->src_addr, ptr, src_address_length);
-    struct in6_addr src_sin_addr;
-    if (inet_pton(sa_family, pp_info->src_addr, &src_sin_addr) != 1)
+    /* Terminated in place, the block is a copy. The space after it is known to be there */
+    *src_address_end = '\0';
+    if (inet_pton(sa_family, ptr, pp1_hdr->src_sin_addr) != 1)
     {
-        return sa_family == AF_INET ? ERR_PP1_IPV4_SRC_IP : ERR_PP1_IPV6_SRC_IP;
+        return sa_family == AF_INET ? -ERR_PP1_IPV4_SRC_IP : -ERR_PP1_IPV6_SRC_IP;
     }
-    ptr += src_address_length;
-
-    /* Exactly one space */
-    if (*ptr != '\x20')
+    if (pp1_hdr->src_addr)
     {
-        return -ERR_PP1_SPACE;
+        memcpy(pp1_hdr->src_addr, ptr, src_address_end - ptr + 1);
     }
-    ptr++;
+    ptr = src_address_end + 1;
 
     /* Destination address */
     char *dst_address_end = strchr(ptr, ' ');
     if (!dst_address_end)
     {
-        return sa_family == AF_INET ? ERR_PP1_IPV4_DST_IP : ERR_PP1_IPV6_DST_IP;
+        return sa_family == AF_INET ? -ERR_PP1_IPV4_DST_IP : -ERR_PP1_IPV6_DST_IP;
     }
-    uint16_t dst_address_length = dst_address_end - ptr;
-    memcpy(pp_info->dst_addr, ptr, dst_address_length);
-    struct in6_addr dst_sin_addr;
-    if (inet_pton(sa_family, pp_info->dst_addr, &dst_sin_addr) != 1)
+    *dst_address_end = '\0';
+    if (inet_pton(sa_family, ptr, pp1_hdr->dst_sin_addr) != 1)
     {
-        return sa_family == AF_INET ? ERR_PP1_IPV4_DST_IP : ERR_PP1_IPV6_DST_IP;
+        return sa_family == AF_INET ? -ERR_PP1_IPV4_DST_IP : -ERR_PP1_IPV6_DST_IP;
     }
-    ptr += dst_address_length;
-
-    /* Exactly one space */
-    if (*ptr != '\x20')
+    if (pp1_hdr->dst_addr)
     {
-        return -ERR_PP1_SPACE;
+        memcpy(pp1_hdr->dst_addr, ptr, dst_address_end - ptr + 1);
     }
-    ptr++;
+    ptr = dst_address_end + 1;
 
     /* TCP source port represented as a decimal integer in the range [0..65535] inclusive */
     char *src_port_end = strchr(ptr, ' ');
@@ -1239,8 +2996,12 @@ static int32_t pp1_parse_hdr(const uint8_t *buffer, uint32_t buffer_length, pp_i
     }
     char src_port_str[6] = { 0 };
     uint16_t src_port_length = src_port_end - ptr;
+    if (src_port_length >= sizeof(src_port_str))
+    {
+        return -ERR_PP1_SRC_PORT;
+    }
     memcpy(src_port_str, ptr, src_port_length);
-    if (!parse_port(src_port_str, &pp_info->src_port))
+    if (!parse_port(src_port_str, &pp1_hdr->src_port))
     {
         return -ERR_PP1_SRC_PORT;
     }
@@ -1261,8 +3022,12 @@ static int32_t pp1_parse_hdr(const uint8_t *buffer, uint32_t buffer_length, pp_i
     }
     char dst_port_str[6] = { 0 };
     uint16_t dst_port_length = dst_port_end - ptr;
+    if (dst_port_length >= sizeof(dst_port_str))
+    {
+        return -ERR_PP1_DST_PORT;
+    }
     memcpy(dst_port_str, ptr, dst_port_length);
-    if (!parse_port(dst_port_str, &pp_info->dst_port))
+    if (!parse_port(dst_port_str, &pp1_hdr->dst_port))
     {
         return -ERR_PP1_DST_PORT;
     }
@@ -1277,19 +3042,436 @@ static int32_t pp1_parse_hdr(const uint8_t *buffer, uint32_t buffer_length, pp_i
     return pp1_hdr_len;
 }
 
-int32_t pp_parse_hdr(uint8_t *buffer, uint32_t buffer_length, pp_info_t *pp_info)
+/* Parses a v1 header into the pp_info. The addresses are also handed back in their binary form as inet_pton() produced them */
+static int32_t pp1_parse_hdr(const uint8_t *buffer, uint32_t buffer_length, pp_info_t *pp_info, struct in6_addr *src_sin_addr, struct in6_addr *dst_sin_addr)
+{
+    pp1_hdr_t pp1_hdr = {
+        .src_addr = pp_info->src_addr,
+        .dst_addr = pp_info->dst_addr,
+        .src_sin_addr = src_sin_addr,
+        .dst_sin_addr = dst_sin_addr
+    };
+    int32_t pp1_hdr_len = pp1_parse_line(buffer, buffer_length, &pp1_hdr);
+    pp_info->address_family = pp1_hdr.address_family;
+    pp_info->transport_protocol = pp1_hdr.transport_protocol;
+    pp_info->src_port = pp1_hdr.src_port;
+    pp_info->dst_port = pp1_hdr.dst_port;
+    return pp1_hdr_len;
+}
+
+static int32_t pp_parse_hdr_version(uint8_t *buffer, uint32_t buffer_length, pp_info_t *pp_info, uint32_t flags)
+{
+    if (buffer_length >= 16 && !memcmp(buffer, PP2_SIG, 12))
+    {
+        /* Fast path for the plain healthcheck header: LOCAL, AF_UNSPEC and nothing else */
+        if (pp2_is_healthcheck_hdr(buffer, buffer_length) == sizeof(pp2_healthcheck_hdr))
+        {
+            pp_info->pp2_info.local = 1;
+            return sizeof(pp2_healthcheck_hdr);
+        }
+        return pp2_parse_hdr(buffer, buffer_length, pp_info, flags);
+    }
+    else if (buffer_length >= 8 && !memcmp(buffer, PP1_SIG, 5))
+    {
+        struct in6_addr src_sin_addr;
+        struct in6_addr dst_sin_addr;
+        return pp1_parse_hdr(buffer, buffer_length, pp_info, &src_sin_addr, &dst_sin_addr);
+    }
+    else
+    {
+        return 0;
+    }
+}
+
+/* Inline storage is handed out anew by every parse, or once per batch */
+static void pp_ctx_reset_inline_storage(pp_ctx_t *ctx)
+{
+    if (ctx && !ctx->arena && ctx->flags & PP_CTX_F_NO_HEAP)
+    {
+        ctx->arena_used = 0;
+    }
+}
+
+static int32_t pp_parse_hdr_flags(pp_ctx_t *ctx, uint8_t *buffer, uint32_t buffer_length, pp_info_t *pp_info, uint32_t flags)
 {
     memset(pp_info, 0, sizeof(*pp_info));
+    pp_info->pp2_info.tlv_array.ctx = ctx;
+    if (ctx && ctx->crc32c_engine == PP_CRC32C_ENGINE_TABLE)
+    {
+        flags |= PP_F_CRC32C_TABLE;
+    }
+    int32_t rc = pp_parse_hdr_version(buffer, buffer_length, pp_info, flags);
+    if (rc == -ERR_HEAP_ALLOC && ctx && pp_ctx_bounded(ctx))
+    {
+        rc = -ERR_PP_CAPACITY;
+    }
+    return rc;
+}
+
+static void pp_ctx_count_parse(pp_ctx_t *ctx, int32_t rc)
+{
+    if (!ctx)
+    {
+        return;
+    }
+    if (rc > 0)
+    {
+        ctx->stats.parsed++;
+        ctx->stats.parsed_bytes += rc;
+    }
+    else if (rc < 0)
+    {
+        ctx->stats.parse_errors++;
+    }
+}
+
+int32_t pp_parse_hdr_ctx(pp_ctx_t *ctx, uint8_t *buffer, uint32_t buffer_length, pp_info_t *pp_info)
+{
+    pp_ctx_reset_inline_storage(ctx);
+    int32_t rc = pp_parse_hdr_flags(ctx, buffer, buffer_length, pp_info, ctx ? ctx->flags : PP_CTX_F_NONE);
+    pp_ctx_count_parse(ctx, rc);
+    return rc;
+}
+
+int32_t pp_parse_hdr(uint8_t *buffer, uint32_t buffer_length, pp_info_t *pp_info)
+{
+    return pp_parse_hdr_ctx(NULL, buffer, buffer_length, pp_info);
+}
+
+static int32_t pp2_parse_hdr_cb(const uint8_t *buffer, uint32_t buffer_length, const pp_parse_cb_t *cb, void *user_data)
+{
+    const uint8_t *tlvs;
+    uint16_t tlvs_len;
+    int32_t pp2_hdr_len = pp2_hdr_locate_tlvs(buffer, buffer_length, &tlvs, &tlvs_len);
+    if (pp2_hdr_len < 0)
+    {
+        return pp2_hdr_len;
+    }
+    const proxy_hdr_v2_t *proxy_hdr_v2 = (const proxy_hdr_v2_t*) buffer;
+    uint8_t cmd = proxy_hdr_v2->ver_cmd & 0x0f;
+    if (cmd > 0x1)
+    {
+        return -ERR_PP2_CMD;
+    }
+    uint8_t address_family = proxy_hdr_v2->fam >> 4;
+    uint8_t transport_protocol = proxy_hdr_v2->fam & 0x0f;
+    if (transport_protocol > TRANSPORT_PROTOCOL_DGRAM)
+    {
+        return -ERR_PP2_TRANSPORT_PROTOCOL;
+    }
+
+    int32_t rc;
+    if (cb->on_hdr && (rc = cb->on_hdr(2, cmd == 0x0, address_family, transport_protocol, user_data)) != ERR_NULL)
+    {
+        return rc;
+    }
+    const proxy_addr_t *addr = (const proxy_addr_t*) (buffer + sizeof(proxy_hdr_v2_t));
+    if (address_family == ADDR_FAMILY_INET)
+    {
+        if ((cb->on_addrs && (rc = cb->on_addrs(address_family, (const uint8_t*) &addr->ipv4_addr.src_addr, (const uint8_t*) &addr->ipv4_addr.dst_addr,
+                                                 sizeof(addr->ipv4_addr.src_addr), user_data)) != ERR_NULL)
+            || (cb->on_ports && (rc = cb->on_ports(ntohs(addr->ipv4_addr.src_port), ntohs(addr->ipv4_addr.dst_port), user_data)) != ERR_NULL))
+        {
+            return rc;
+        }
+    }
+    else if (address_family == ADDR_FAMILY_INET6)
+    {
+        if ((cb->on_addrs && (rc = cb->on_addrs(address_family, addr->ipv6_addr.src_addr, addr->ipv6_addr.dst_addr,
+                                                 sizeof(addr->ipv6_addr.src_addr), user_data)) != ERR_NULL)
+            || (cb->on_ports && (rc = cb->on_ports(ntohs(addr->ipv6_addr.src_port), ntohs(addr->ipv6_addr.dst_port), user_data)) != ERR_NULL))
+        {
+            return rc;
+        }
+    }
+    else if (address_family == ADDR_FAMILY_UNIX)
+    {
+        if (cb->on_addrs && (rc = cb->on_addrs(address_family, addr->unix_addr.src_addr, addr->unix_addr.dst_addr,
+                                                sizeof(addr->unix_addr.src_addr), user_data)) != ERR_NULL)
+        {
+            return rc;
+        }
+    }
+
+    pp_tlv_iter_t iter;
+    uint32_t crc32c_offset = 0;
+    pp_tlv_iter_init_region(&iter, tlvs, tlvs_len);
+    while (pp_tlv_iter_next(&iter))
+    {
+        if (iter.type == PP2_TYPE_CRC32C)
+        {
+            if (iter.length != sizeof(uint32_t) || crc32c_offset)
+            {
+                return -ERR_PP2_TYPE_CRC32C;
+            }
+            crc32c_offset = iter.value - buffer;
+        }
+        if (cb->on_tlv && (rc = cb->on_tlv(iter.type, iter.value, iter.length, user_data)) != ERR_NULL)
+        {
+            return rc;
+        }
+    }
+    if (iter.error != ERR_NULL)
+    {
+        return iter.error;
+    }
+    if (crc32c_offset && !pp2_hdr_crc32c_matches(buffer, pp2_hdr_len, crc32c_offset, PP_CRC32C_ENGINE_AUTO))
+    {
+        return -ERR_PP2_TYPE_CRC32C;
+    }
+    return pp2_hdr_len;
+}
+
+static int32_t pp1_parse_hdr_cb(const uint8_t *buffer, uint32_t buffer_length, const pp_parse_cb_t *cb, void *user_data)
+{
+    struct in6_addr src_sin_addr;
+    struct in6_addr dst_sin_addr;
+    pp1_hdr_t pp1_hdr = {
+        .address_family = ADDR_FAMILY_UNSPEC,
+        .src_sin_addr = &src_sin_addr,
+        .dst_sin_addr = &dst_sin_addr
+    };
+    int32_t pp1_hdr_len = pp1_parse_line(buffer, buffer_length, &pp1_hdr);
+    if (pp1_hdr_len <= 0)
+    {
+        return pp1_hdr_len;
+    }
+
+    int32_t rc;
+    if (cb->on_hdr && (rc = cb->on_hdr(1, 0, pp1_hdr.address_family, pp1_hdr.transport_protocol, user_data)) != ERR_NULL)
+    {
+        return rc;
+    }
+    if (pp1_hdr.address_family == ADDR_FAMILY_UNSPEC)
+    {
+        return pp1_hdr_len;
+    }
+    if ((cb->on_addrs && (rc = cb->on_addrs(pp1_hdr.address_family, (const uint8_t*) &src_sin_addr, (const uint8_t*) &dst_sin_addr,
+                                             pp1_hdr.address_family == ADDR_FAMILY_INET ? 4 : 16, user_data)) != ERR_NULL)
+        || (cb->on_ports && (rc = cb->on_ports(pp1_hdr.src_port, pp1_hdr.dst_port, user_data)) != ERR_NULL))
+    {
+        return rc;
+    }
+    return pp1_hdr_len;
+}
+
+int32_t pp_parse_hdr_cb(const uint8_t *buffer, uint32_t buffer_length, const pp_parse_cb_t *cb, void *user_data)
+{
+    if (buffer_length >= 16 && !memcmp(buffer, PP2_SIG, 12))
+    {
+        return pp2_parse_hdr_cb(buffer, buffer_length, cb, user_data);
+    }
+    else if (buffer_length >= 8 && !memcmp(buffer, PP1_SIG, 5))
+    {
+        return pp1_parse_hdr_cb(buffer, buffer_length, cb, user_data);
+    }
+    else
+    {
+        return 0;
+    }
+}
+
+/* Settles the batched parse results once the checksums are calculated */
+static void pp_parse_hdr_batch_flush(pp2_crc32c_batch_t *batch, pp_ctx_t *ctx, pp_info_t *pp_infos, int32_t *results)
+{
+    uint32_t i;
+    pp2_crc32c_batch_flush(batch);
+    for (i = 0; i < batch->count; i++)
+    {
+        uint32_t index = batch->index[i];
+        if (pp2_crc32c_batch_matches(batch, i))
+        {
+            pp_infos[index].pp2_info.crc32c = 1;
+        }
+        else
+        {
+            results[index] = -ERR_PP2_TYPE_CRC32C;
+        }
+        pp_ctx_count_parse(ctx, results[index]);
+    }
+    batch->count = 0;
+}
+
+uint32_t pp_parse_hdr_batch(pp_ctx_t *ctx, uint8_t *const *buffers, const uint32_t *buffer_lengths, uint32_t count, pp_info_t *pp_infos, int32_t *results)
+{
+    uint32_t flags = ctx ? ctx->flags : PP_CTX_F_NONE;
+    pp2_crc32c_batch_t batch;
+    uint32_t i;
+    batch.count = 0;
+    batch.engine = ctx ? ctx->crc32c_engine : PP_CRC32C_ENGINE_AUTO;
+    pp_ctx_reset_inline_storage(ctx);
+    for (i = 0; i < count; i++)
+    {
+        /* The checksums are left to the batch unless the caller deferred or skips them itself */
+        results[i] = pp_parse_hdr_flags(ctx, buffers[i], buffer_lengths[i], &pp_infos[i], flags | PP_CTX_F_CRC32C_DEFERRED);
+        if (results[i] > 0 && pp_infos[i].pp2_info.crc32c == 2 && !(flags & (PP_CTX_F_CRC32C_DEFERRED | PP_CTX_F_CRC32C_SKIP)))
+        {
+            pp2_crc32c_batch_add(&batch, buffers[i], results[i], pp_infos[i].pp2_info.crc32c_offset, i);
+            if (batch.count == PP2_CRC32C_BATCH)
+            {
+                pp_parse_hdr_batch_flush(&batch, ctx, pp_infos, results);
+            }
+        }
+        else
+        {
+            pp_ctx_count_parse(ctx, results[i]);
+        }
+    }
+    pp_parse_hdr_batch_flush(&batch, ctx, pp_infos, results);
+
+    uint32_t parsed = 0;
+    for (i = 0; i < count; i++)
+    {
+        parsed += results[i] > 0;
+    }
+    return parsed;
+}
+
+int32_t pp_parse_dgram_hdr(pp_ctx_t *ctx, uint8_t *datagram, uint32_t datagram_length, pp_info_t *pp_info)
+{
+    /* Only v2 is defined for datagrams. Anything else, a v1 line included, is payload */
+    if (datagram_length < sizeof(proxy_hdr_v2_t) || memcmp(datagram, PP2_SIG, 12))
+    {
+        memset(pp_info, 0, sizeof(*pp_info));
+        return 0;
+    }
+
+    pp_ctx_reset_inline_storage(ctx);
+    int32_t rc = pp_parse_hdr_flags(ctx, datagram, datagram_length, pp_info, ctx ? ctx->flags : PP_CTX_F_NONE);
+    if (rc > 0 && !pp_info->pp2_info.local && pp_info->transport_protocol != TRANSPORT_PROTOCOL_DGRAM)
+    {
+        rc = -ERR_PP2_TRANSPORT_PROTOCOL;
+    }
+    pp_ctx_count_parse(ctx, rc);
+    return rc;
+}
+
+#ifndef _WIN32
+void pp_dgram_iov_prepend(const uint8_t *pp_hdr, uint16_t pp_hdr_len, const struct iovec *payloads, uint32_t count, struct iovec *iovs)
+{
+    uint32_t i;
+    for (i = 0; i < count; i++)
+    {
+        iovs[2 * i].iov_base = (void*) pp_hdr;
+        iovs[2 * i].iov_len = pp_hdr_len;
+        iovs[2 * i + 1] = payloads[i];
+    }
+}
+#endif
+
+/* v2 header to v1 line, formatted straight from the binary addresses */
+static int32_t pp_transcode_v2_to_v1(pp_builder_t *builder, const uint8_t *buffer, uint32_t buffer_length, uint16_t *pp_hdr_len)
+{
+    const uint8_t *tlvs;
+    uint16_t tlvs_len;
+    int32_t pp2_hdr_len = pp2_hdr_locate_tlvs(buffer, buffer_length, &tlvs, &tlvs_len);
+    if (pp2_hdr_len < 0)
+    {
+        return pp2_hdr_len;
+    }
+
+    /* Malformed headers are rejected the way pp2_parse_hdr() rejects them */
+    const proxy_hdr_v2_t *proxy_hdr_v2 = (const proxy_hdr_v2_t*) buffer;
+    const proxy_addr_t *proxy_addr = (const proxy_addr_t*) (buffer + sizeof(proxy_hdr_v2_t));
+    uint8_t cmd = proxy_hdr_v2->ver_cmd & 0x0f;
+    if (cmd > 0x1)
+    {
+        return -ERR_PP2_CMD;
+    }
+    uint8_t transport_protocol = proxy_hdr_v2->fam & 0x0f;
+    if (transport_protocol > TRANSPORT_PROTOCOL_DGRAM)
+    {
+        return -ERR_PP2_TRANSPORT_PROTOCOL;
+    }
+
+    /* LOCAL and what v1 cannot express (AF_UNSPEC, AF_UNIX, datagrams) are what the v1 UNKNOWN stands for */
+    uint8_t address_family = proxy_hdr_v2->fam >> 4;
+    if (cmd == 0x0 || transport_protocol != TRANSPORT_PROTOCOL_STREAM
+        || (address_family != ADDR_FAMILY_INET && address_family != ADDR_FAMILY_INET6))
+    {
+        address_family = ADDR_FAMILY_UNSPEC;
+    }
+
+    int32_t error;
+    uint8_t rc;
+    if (address_family == ADDR_FAMILY_INET)
+    {
+        rc = pp1_hdr_write_line(NULL, address_family, (const uint8_t*) &proxy_addr->ipv4_addr.src_addr, (const uint8_t*) &proxy_addr->ipv4_addr.dst_addr,
+                                ntohs(proxy_addr->ipv4_addr.src_port), ntohs(proxy_addr->ipv4_addr.dst_port),
+                                &builder->hdr, &builder->hdr_size, pp_hdr_len, &error);
+    }
+    else if (address_family == ADDR_FAMILY_INET6)
+    {
+        rc = pp1_hdr_write_line(NULL, address_family, proxy_addr->ipv6_addr.src_addr, proxy_addr->ipv6_addr.dst_addr,
+                                ntohs(proxy_addr->ipv6_addr.src_port), ntohs(proxy_addr->ipv6_addr.dst_port),
+                                &builder->hdr, &builder->hdr_size, pp_hdr_len, &error);
+    }
+    else
+    {
+        rc = pp1_hdr_write_line(NULL, address_family, NULL, NULL, 0, 0, &builder->hdr, &builder->hdr_size, pp_hdr_len, &error);
+    }
+    return rc ? pp2_hdr_len : error;
+}
+
+/* v1 line to v2 header, built straight from the binary addresses of the v1 parsing */
+static int32_t pp_transcode_v1_to_v2(pp_builder_t *builder, const uint8_t *buffer, uint32_t buffer_length, uint16_t *pp_hdr_len)
+{
+    /* The v1 parsing leaves the addresses in the builder's pp_info too */
+    pp_info_t *pp_info = &builder->pp_info;
+    struct in6_addr src_sin_addr;
+    struct in6_addr dst_sin_addr;
+    memset(pp_info->src_addr, 0, sizeof(pp_info->src_addr));
+    memset(pp_info->dst_addr, 0, sizeof(pp_info->dst_addr));
+    pp_info->src_port = pp_info->dst_port = 0;
+    int32_t pp1_hdr_len = pp1_parse_hdr(buffer, buffer_length, pp_info, &src_sin_addr, &dst_sin_addr);
+    if (pp1_hdr_len <= 0)
+    {
+        return pp1_hdr_len;
+    }
+
+    proxy_addr_t proxy_addr;
+    uint16_t proxy_addr_len = 0;
+    if (pp_info->address_family == ADDR_FAMILY_INET)
+    {
+        memcpy(&proxy_addr.ipv4_addr.src_addr, &src_sin_addr, sizeof(proxy_addr.ipv4_addr.src_addr));
+        memcpy(&proxy_addr.ipv4_addr.dst_addr, &dst_sin_addr, sizeof(proxy_addr.ipv4_addr.dst_addr));
+        proxy_addr.ipv4_addr.src_port = htons(pp_info->src_port);
+        proxy_addr.ipv4_addr.dst_port = htons(pp_info->dst_port);
+        proxy_addr_len = sizeof(proxy_addr.ipv4_addr);
+    }
+    else if (pp_info->address_family == ADDR_FAMILY_INET6)
+    {
+        memcpy(proxy_addr.ipv6_addr.src_addr, &src_sin_addr, sizeof(proxy_addr.ipv6_addr.src_addr));
+        memcpy(proxy_addr.ipv6_addr.dst_addr, &dst_sin_addr, sizeof(proxy_addr.ipv6_addr.dst_addr));
+        proxy_addr.ipv6_addr.src_port = htons(pp_info->src_port);
+        proxy_addr.ipv6_addr.dst_port = htons(pp_info->dst_port);
+        proxy_addr_len = sizeof(proxy_addr.ipv6_addr);
+    }
+
+    int32_t error;
+    if (!pp2_hdr_write(NULL, pp_info, pp_info->address_family, &proxy_addr, proxy_addr_len, builder->tlvs, builder->tlvs_len,
+                       &builder->hdr, &builder->hdr_size, pp_hdr_len, NULL, &error))
+    {
+        return error;
+    }
+    return pp1_hdr_len;
+}
+
+int32_t pp_transcode(pp_builder_t *builder, const uint8_t *buffer, uint32_t buffer_length, const uint8_t **pp_hdr, uint16_t *pp_hdr_len)
+{
+    int32_t rc;
     if (buffer_length >= 16 && !memcmp(buffer, PP2_SIG, 12))
     {
-        return pp2_parse_hdr(buffer, buffer_length, pp_info);
+        rc = pp_transcode_v2_to_v1(builder, buffer, buffer_length, pp_hdr_len);
     }
     else if (buffer_length >= 8 && !memcmp(buffer, PP1_SIG, 5))
     {
-        return pp1_parse_hdr(buffer, buffer_length, pp_info);;
+        rc = pp_transcode_v1_to_v2(builder, buffer, buffer_length, pp_hdr_len);
     }
     else
     {
         return 0;
     }
+    *pp_hdr = rc > 0 ? builder->hdr : NULL;
+    return rc;
 }
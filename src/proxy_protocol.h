@@ -19,8 +19,12 @@
 #ifndef PROXY_PROTOCOL_H
 #define PROXY_PROTOCOL_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+struct sockaddr;
+struct iovec;
+
 enum
 {
     ERR_NULL,
@@ -51,7 +55,10 @@ enum
     ERR_PP1_IPV6_DST_IP,
     ERR_PP1_SRC_PORT,
     ERR_PP1_DST_PORT,
-    ERR_HEAP_ALLOC
+    ERR_HEAP_ALLOC,
+    ERR_PP_CAPACITY,
+    ERR_PP2_TLV_DUPLICATE,
+    ERR_PP2_TLV_COUNT
 };
 
 /* Returns a descriptive error message
@@ -61,6 +68,11 @@ enum
  */
 const char *pp_strerror(int32_t error);
 
+/* 256 bit masks of TLV types, e.g. the strip_types of pp2_forward_hdr() or pp2_info_t's tlv_types */
+#define PP_TLV_TYPE_MASK_SIZE            32
+#define PP_TLV_TYPE_MASK_SET(mask, type)   ((mask)[(uint8_t) (type) >> 3] |= (uint8_t) (1 << ((type) & 7)))
+#define PP_TLV_TYPE_MASK_ISSET(mask, type) (((mask)[(uint8_t) (type) >> 3] >> ((type) & 7)) & 1)
+
 typedef struct
 {
     uint8_t ssl;                /* 1: client connected over SSL/TLS 0: otherwise */
@@ -69,13 +81,39 @@ typedef struct
     uint8_t cert_verified;      /* 1: client presented a certificate and it was successfully verified 0: otherwise */
 } pp2_ssl_info_t;
 
+/* The PP2_TYPE_SSL TLV of a parsed header, filled in the same pass that parses it.
+ * The pointers are to the values kept in the pp_info_t's tlv_array and are valid until pp_info_clear().
+ * The lengths are the ones on the wire, i.e. without the NULL terminator the US-ASCII values get.
+ * When a sub-TLV is repeated the first one is kept. NULL: the sub-TLV is absent.
+ * A header carrying the PP2_TYPE_SSL TLV itself more than once is rejected with -ERR_PP2_TYPE_SSL
+ */
+typedef struct
+{
+    uint8_t        client;      /* Raw <client> bit field */
+    uint32_t       verify;      /* Raw <verify> word in host byte order. 0: client presented a certificate and it was successfully verified */
+    const uint8_t *version;
+    const uint8_t *cn;
+    const uint8_t *cipher;
+    const uint8_t *sig_alg;
+    const uint8_t *key_alg;
+    uint16_t       version_len;
+    uint16_t       cn_len;
+    uint16_t       cipher_len;
+    uint16_t       sig_alg_len;
+    uint16_t       key_alg_len;
+    uint16_t       unknown;     /* Number of sub-TLVs of other types. Skipped, see pp_tlv_iter_init_ssl() */
+} pp2_ssl_view_t;
+
 typedef struct _pp2_tlv_t pp2_tlv_t;
+typedef struct _pp_ctx_t pp_ctx_t;
 
 typedef struct
 {
     uint32_t    len;  /* Number of elements  */
     uint32_t    size; /* Allocated elements  */
     pp2_tlv_t **tlvs; /* Pointer to pp2_tlv_t* elements */
+    pp_ctx_t   *ctx;  /* Context whose allocator the elements come from. NULL: malloc() and free() */
+    uint8_t     bounded; /* Internal. 1: the elements come from the context's arena or inline storage. Fixed at the first allocation */
 } tlv_array_t;
 
 typedef struct
@@ -91,16 +129,29 @@ typedef struct
      */
     uint8_t        alignment_power;
     pp2_ssl_info_t pp2_ssl_info;
+    pp2_ssl_view_t pp2_ssl_view; /* Parsing: The PP2_TYPE_SSL TLV. Creation: Ignored */
+    /*
+     * In parsing:
+     *      The types of the TLVs present, to be tested with PP_TLV_TYPE_MASK_ISSET() before or instead of a pp_info_get_*() lookup.
+     *      Every top level TLV counts, NOOP and unknown types included, and so do the PP2_TYPE_SSL sub-TLVs
+     * In creation:
+     *      Set by the pp_info_add_*() functions for the TLVs they add
+     * The pp_info_get_*() functions use it only to skip the lookup of an absent type; when it is all zero they look anyway
+     */
+    uint8_t        tlv_types[PP_TLV_TYPE_MASK_SIZE];
     tlv_array_t    tlv_array;
     /*
      * In creation:
      *      1: calculate and add crc32c checksum TLV
      *      0: no crc32c checksum
      * In parsing:
+     *      3: crc32c checksum TLV is present and accepted without verification (PP_CTX_F_CRC32C_SKIP)
+     *      2: crc32c checksum TLV is present but its verification was deferred (PP_CTX_F_CRC32C_DEFERRED). See pp_info_verify_crc32c()
      *      1: crc32c checksum TLV is present and verified. Optionally, pp_info_get_crc32c() can be used to get the value
      *      0: crc32c checksum is not present
      */
-    uint8_t crc32c;
+    uint8_t  crc32c;
+    uint32_t crc32c_offset; /* Parsing: Internal. Offset of the checksum within the header */
 } pp2_info_t;
 
 enum
@@ -130,6 +181,110 @@ typedef struct
 } pp_info_t;
 
 
+/* A reusable header builder meant to live as long as a worker does.
+ * Its TLV storage and output buffer are retained across pp_builder_reset() so that,
+ * once they have grown to the working size, creating a header does not allocate.
+ *
+ * pp_info      Header information. Set its fields directly. TLVs are added through pp_builder_add_*()
+ * Rest         Internal. Not to be touched
+ */
+typedef struct
+{
+    pp_info_t pp_info;
+    uint8_t  *tlvs;      /* TLVs in wire format */
+    uint32_t  tlvs_len;
+    uint32_t  tlvs_size;
+    uint8_t  *hdr;       /* Output buffer */
+    uint32_t  hdr_size;
+} pp_builder_t;
+
+/* CRC32c implementations a pp_ctx_t can select */
+enum
+{
+    PP_CRC32C_ENGINE_AUTO,  /* Best one available on the running CPU for each length, e.g. PCLMULQDQ or VPCLMULQDQ folding on x86-64 */
+    PP_CRC32C_ENGINE_TABLE, /* Portable lookup table */
+};
+
+/* pp_ctx_t option flags */
+#define PP_CTX_F_NONE             0x00000000
+#define PP_CTX_F_NO_HEAP          0x00000001 /* Without an arena, allocate from the context's inline storage instead of the heap */
+#define PP_CTX_F_CRC32C_DEFERRED  0x00000002 /* Record the PP2_TYPE_CRC32C checksum but verify it only through pp_info_verify_crc32c() */
+#define PP_CTX_F_CRC32C_SKIP      0x00000004 /* Trusted upstreams: accept the PP2_TYPE_CRC32C checksum without recomputing it */
+#define PP_CTX_F_STRICT_TLVS      0x00000008 /* Untrusted clients: reject a repeated ALPN, AUTHORITY, CRC32C, UNIQUE_ID, SSL or NETNS TLV
+                                                * and headers of more than PP_STRICT_MAX_TLVS TLVs */
+
+/* Fixed capacity of a pp_ctx_t's inline storage: values plus TLV slots (pointers) */
+#define PP_CTX_INLINE_STORAGE_SIZE 512
+#define PP_CTX_INLINE_TLV_SLOTS    16
+
+/* Most TLVs a header may carry with PP_CTX_F_STRICT_TLVS, NOOP and unknown types included */
+#define PP_STRICT_MAX_TLVS         32
+
+typedef struct
+{
+    uint64_t parsed;        /* Headers parsed successfully */
+    uint64_t parsed_bytes;  /* Sum of their lengths */
+    uint64_t parse_errors;  /* Parsing calls which returned an error */
+    uint64_t created;       /* Headers created successfully */
+    uint64_t create_errors; /* Creation calls which failed */
+    uint64_t allocations;   /* Allocations made through the context */
+} pp_ctx_stats_t;
+
+/* Application decoder of a TLV type, called from the parser's single pass over the TLVs right after the library's own handling of it.
+ * Also called for the types the library does not keep, e.g. vendor specific ones. Not called for PP2_TYPE_SSL sub-TLVs
+ *
+ * type         The TLV's type
+ * value        The TLV's value within the parsed buffer
+ * length       The value's length
+ * pp_info      The pp_info_t being filled
+ * user_data    The pointer given to pp_register_tlv_handler()
+ * return       ERR_NULL to go on, < 0 to abort the parsing which then returns this value
+ */
+typedef int32_t (*pp_tlv_handler_t)(uint8_t type, const uint8_t *value, uint16_t length, pp_info_t *pp_info, void *user_data);
+
+/* Handlers of all the 256 TLV types. Read only once set up so one table can serve the contexts of all the threads */
+typedef struct
+{
+    pp_tlv_handler_t handlers[256];
+    void            *user_data[256];
+} pp_tlv_handlers_t;
+
+/* Per-thread state of the _ctx functions. The library itself keeps no mutable global state,
+ * so a context pinned to each worker thread is all that is needed for them to share nothing.
+ * A context must not be used by two threads at the same time
+ *
+ * flags          Combination of PP_CTX_F_* options. They may change between calls, e.g. per listener
+ * crc32c_engine  One of PP_CRC32C_ENGINE_*. Used by every checksum the context's parsing, creation and batch calls
+ *                and pp_info_verify_crc32c() calculate
+ * realloc_fn     Allocator hook with the semantics of realloc(). NULL: realloc()
+ * free_fn        Deallocator hook with the semantics of free(). NULL: free()
+ * stats          Counters updated by the _ctx functions. Reset them at will
+ * tlv_handlers   Application TLV handlers used when parsing. NULL: none
+ * Rest           Internal. Set through pp_ctx_set_arena()
+ *
+ * Zero allocation mode: with PP_CTX_F_NO_HEAP and no arena, everything is served from the inline storage and
+ * the heap is never touched. Exceeding it fails with -ERR_PP_CAPACITY.
+ *
+ * Ownership: the TLVs of a pp_info_t parsed from the inline storage or an arena belong to the context, not to the pp_info_t.
+ * Every pp_parse_hdr_ctx() and pp_parse_hdr_batch() starts the inline storage over, and pp_ctx_reset_arena() the arena,
+ * which invalidates the TLVs, SSL view included, of every pp_info_t parsed before from that storage, as well as the headers
+ * created from it. pp_info_clear() remains safe to call on such a pp_info_t. Copy out whatever has to live longer or give
+ * each long lived pp_info_t a context of its own
+ */
+struct _pp_ctx_t
+{
+    uint32_t        flags;
+    uint8_t         crc32c_engine;
+    void         *(*realloc_fn)(void *ptr, size_t size);
+    void          (*free_fn)(void *ptr);
+    pp_ctx_stats_t  stats;
+    const pp_tlv_handlers_t *tlv_handlers;
+    uint8_t        *arena;
+    uint32_t        arena_size;
+    uint32_t        arena_used;
+    uint64_t        inline_storage[(PP_CTX_INLINE_STORAGE_SIZE + PP_CTX_INLINE_TLV_SLOTS * sizeof(void*)) / sizeof(uint64_t)];
+};
+
 /* Adds the specified TLV in the given pp_info
  *
  * pp_info          Pointer to a pp_info_t structure to be used in pp_create_hdr()
@@ -145,6 +300,30 @@ uint8_t pp_info_add_netns(pp_info_t *pp_info, const char *netns);
 uint8_t pp_info_add_aws_vpce_id(pp_info_t *pp_info, const char *vpce_id);
 uint8_t pp_info_add_azure_linkid(pp_info_t *pp_info, uint32_t linkid);
 
+/* Same as their counterparts above but with explicit lengths instead of NULL terminated strings.
+ * The value is written once, straight into the TLV storage of the given pp_info
+ *
+ * $value_len   The length of the respective value. A 0 length or a NULL value omits that SSL sub-TLV
+ */
+uint8_t pp_info_add_ssl_len(pp_info_t *pp_info, const char *version, uint16_t version_len, const char *cipher, uint16_t cipher_len,
+                            const char *sig_alg, uint16_t sig_alg_len, const char *key_alg, uint16_t key_alg_len, const uint8_t *cn, uint16_t cn_len);
+uint8_t pp_info_add_aws_vpce_id_len(pp_info_t *pp_info, uint16_t length, const char *vpce_id);
+
+/* Same as the pp_info_add_*() functions but the TLVs go to the builder's retained storage.
+ * All the values are given with explicit lengths
+ *
+ * builder          Pointer to a pp_builder_t structure initialized with pp_builder_init()
+ * return           1: success 0: failure
+ */
+uint8_t pp_builder_add_alpn(pp_builder_t *builder, uint16_t length, const uint8_t *alpn);
+uint8_t pp_builder_add_authority(pp_builder_t *builder, uint16_t length, const uint8_t *host_name);
+uint8_t pp_builder_add_unique_id(pp_builder_t *builder, uint16_t length, const uint8_t *unique_id);
+uint8_t pp_builder_add_ssl(pp_builder_t *builder, const char *version, uint16_t version_len, const char *cipher, uint16_t cipher_len,
+                           const char *sig_alg, uint16_t sig_alg_len, const char *key_alg, uint16_t key_alg_len, const uint8_t *cn, uint16_t cn_len);
+uint8_t pp_builder_add_netns(pp_builder_t *builder, uint16_t length, const char *netns);
+uint8_t pp_builder_add_aws_vpce_id(pp_builder_t *builder, uint16_t length, const char *vpce_id);
+uint8_t pp_builder_add_azure_linkid(pp_builder_t *builder, uint32_t linkid);
+
 /* Searches for the specified TLV and returns its value
  *
  * pp_info  Pointer to a pp_info_t structure used in pp_parse()
@@ -189,6 +368,24 @@ void pp_info_clear(pp_info_t *pp_info);
  */
 uint8_t *pp2_create_healthcheck_hdr(uint16_t *pp2_hdr_len, int32_t *error);
 
+/* Returns a constant v2 healthcheck PROXY protocol header (LOCAL, AF_UNSPEC) without any allocation.
+ * Same content as the one pp2_create_healthcheck_hdr() creates when crc32c is 0
+ *
+ * crc32c       1: header including a PP2_TYPE_CRC32C TLV 0: plain 16 bytes header
+ * pp2_hdr_len  Pointer to a uint16_t where the length of the PROXY protocol header will be set
+ * return       Pointer to a static read only buffer containing the PROXY protocol header. Must NOT be freed
+ */
+const uint8_t *pp2_get_healthcheck_hdr(uint8_t crc32c, uint16_t *pp2_hdr_len);
+
+/* Checks whether the buffer starts with one of the constant healthcheck headers of pp2_get_healthcheck_hdr()
+ *
+ * buffer           Buffer to be inspected
+ * buffer_length    Buffer's length
+ * return           > 0 Length of the healthcheck header found
+ *                  0   Not a constant healthcheck header. pp_parse_hdr() should be used instead
+ */
+uint16_t pp2_is_healthcheck_hdr(const uint8_t *buffer, uint32_t buffer_length);
+
 /* Creates a PROXY protocol header considering the information inside the pp_info.
  *
  * version:     1 Create a v1 PROXY protocol header
@@ -202,6 +399,114 @@ uint8_t *pp2_create_healthcheck_hdr(uint16_t *pp2_hdr_len, int32_t *error);
  */
 uint8_t *pp_create_hdr(uint8_t version, const pp_info_t *pp_info, uint16_t *pp_hdr_len, int32_t *error);
 
+/* Initializes a pp_builder_t structure. No allocation takes place until needed */
+void pp_builder_init(pp_builder_t *builder);
+
+/* Same as pp_create_hdr() for the builder's pp_info and TLVs but the header is created in the builder's output buffer
+ *
+ * return       Pointer to the builder's output buffer containing the PROXY protocol header else NULL.
+ *              Valid until the next pp_builder_create_hdr() or pp_builder_free(). Must NOT be freed
+ */
+const uint8_t *pp_builder_create_hdr(pp_builder_t *builder, uint8_t version, uint16_t *pp_hdr_len, int32_t *error);
+
+/* Clears the builder's pp_info and TLVs so that it can be used for the next header. The allocated capacity is kept */
+void pp_builder_reset(pp_builder_t *builder);
+
+/* Frees any memory associated with the builder */
+void pp_builder_free(pp_builder_t *builder);
+
+/* Same as pp_create_hdr() and pp_builder_create_hdr() but the addresses and ports are taken directly from
+ * a pair of sockaddr, typically the ones of accept()/getpeername() and getsockname(), instead of pp_info's text addresses.
+ * The pp_info's address_family, src_addr, dst_addr, src_port and dst_port are ignored.
+ *
+ * src          Pointer to a struct sockaddr_in, sockaddr_in6 or sockaddr_un (v2 only) with the source address
+ * dst          Pointer to a struct sockaddr of the same family as src with the destination address
+ */
+uint8_t *pp_create_hdr_from_sockaddr(uint8_t version, const pp_info_t *pp_info, const struct sockaddr *src, const struct sockaddr *dst, uint16_t *pp_hdr_len, int32_t *error);
+const uint8_t *pp_builder_create_hdr_from_sockaddr(pp_builder_t *builder, uint8_t version, const struct sockaddr *src, const struct sockaddr *dst,
+                                                   uint16_t *pp_hdr_len, int32_t *error);
+
+/* Fills the address_family, transport_protocol, src_addr, dst_addr, src_port and dst_port of the pp_info
+ * from a connected socket. The source is the peer (getpeername()), the destination is the local end (getsockname())
+ *
+ * fd       Connected socket
+ * pp_info  Pointer to a pp_info_t structure. The rest of its fields are left untouched
+ * return   1: success 0: failure
+ */
+uint8_t pp_info_from_socket(int fd, pp_info_t *pp_info);
+
+/* Zero allocation iterator over the TLVs of a v2 PROXY protocol header, known and unknown types alike.
+ * The yielded values are views into the header bytes which have to outlive the iteration
+ *
+ * type     Type of the current TLV
+ * length   Length of the current TLV's value
+ * value    Pointer to the current TLV's value
+ * tlv      Pointer to the current TLV's first byte (type) e.g. for forwarding it as is
+ * error    ERR_NULL or < 0 if the iteration stopped at a malformed TLV
+ * Rest     Internal. Not to be touched
+ */
+typedef struct
+{
+    uint8_t        type;
+    uint16_t       length;
+    const uint8_t *value;
+    const uint8_t *tlv;
+    int32_t        error;
+    const uint8_t *next;
+    const uint8_t *end;
+} pp_tlv_iter_t;
+
+/* Initializes an iterator over the TLVs of a v2 PROXY protocol header. Only the header's framing is looked at
+ *
+ * buffer           Buffer starting with a v2 PROXY protocol header
+ * buffer_length    Buffer's length
+ * return           > 0 Length of the v2 PROXY protocol header
+ *                  < 0 Error occurred. pp_tlv_iter_next() yields nothing
+ */
+int32_t pp_tlv_iter_init(pp_tlv_iter_t *iter, const uint8_t *buffer, uint32_t buffer_length);
+
+/* Initializes an iterator over the sub-TLVs of the PP2_TYPE_SSL TLV the given iterator currently is at
+ *
+ * return   ERR_NULL on success else < 0
+ */
+int32_t pp_tlv_iter_init_ssl(pp_tlv_iter_t *sub_iter, const pp_tlv_iter_t *iter);
+
+/* Advances to the next TLV. Fewer bytes than a TLV header at the end are ignored, the way pp_parse_hdr() ignores them
+ *
+ * return   1: the iterator's type, length, value and tlv are set 0: no more TLVs or iter->error is set
+ */
+uint8_t pp_tlv_iter_next(pp_tlv_iter_t *iter);
+
+/* pp2_forward_hdr() option flags */
+#define PP2_FORWARD_F_NONE         0x00
+#define PP2_FORWARD_F_CRC32C       0x01 /* Add a freshly calculated PP2_TYPE_CRC32C TLV */
+#define PP2_FORWARD_F_CRC32C_SKIP  0x02 /* Trusted upstreams: drop the received PP2_TYPE_CRC32C TLV without verifying it */
+
+/* Rewrites a received v2 PROXY protocol header for forwarding in a single copy pass over its bytes.
+ * The kept TLVs stay in their original order and are followed by the appended ones. The header's length is patched.
+ * A received PP2_TYPE_CRC32C TLV is verified, so that a corrupted header is not passed on with a valid checksum, then removed
+ * and, if requested, a freshly calculated one is added last. Neither addresses nor TLVs are decoded
+ *
+ * hdr              Buffer starting with the received v2 PROXY protocol header
+ * hdr_length       Buffer's length
+ * strip_types      PP_TLV_TYPE_MASK_SIZE bytes mask of the TLV types to be removed. NULL: none
+ * append_tlvs      Already encoded TLVs to be appended e.g. with pp2_tlv_write()
+ * append_tlvs_len  Length of append_tlvs
+ * flags            Combination of PP2_FORWARD_F_* options
+ * out              Buffer where the forwarded header will be written. It may be hdr itself (in place) but not overlap append_tlvs
+ * out_size         Size of out
+ * return           > 0 Length of the forwarded header
+ *                  < 0 Error occurred. -ERR_PP2_LENGTH also when out is too small. -ERR_PP2_TYPE_CRC32C: the received checksum is wrong
+ */
+int32_t pp2_forward_hdr(const uint8_t *hdr, uint32_t hdr_length, const uint8_t *strip_types, const uint8_t *append_tlvs, uint16_t append_tlvs_len,
+                        uint8_t flags, uint8_t *out, uint32_t out_size);
+
+/* Encodes a TLV
+ *
+ * return   Number of bytes written else 0 if out_size is not enough
+ */
+uint16_t pp2_tlv_write(uint8_t *out, uint32_t out_size, uint8_t type, uint16_t length, const uint8_t *value);
+
 /* Inpects the buffer for a PROXY protocol header and extracts all the information if any
  *
  * buffer           Buffer to be inspected and parsed. Typically the buffer given for a read operation
@@ -213,4 +518,177 @@ uint8_t *pp_create_hdr(uint8_t version, const pp_info_t *pp_info, uint16_t *pp_h
  */
 int32_t pp_parse_hdr(uint8_t *buffer, uint32_t buffer_length, pp_info_t *pp_info);
 
+/* Initializes a context: default options, the standard allocator and zeroed statistics
+ *
+ * ctx  Pointer to the pp_ctx_t to be initialized
+ */
+void pp_ctx_init(pp_ctx_t *ctx);
+
+/* Sets the handler of a TLV type, replacing any previous one
+ *
+ * handlers     Pointer to a zeroed pp_tlv_handlers_t, later set as some contexts' tlv_handlers
+ * type         The TLV type
+ * handler      The handler. NULL: none
+ * user_data    Passed to the handler as is
+ */
+void pp_register_tlv_handler(pp_tlv_handlers_t *handlers, uint8_t type, pp_tlv_handler_t handler, void *user_data);
+
+/* Makes the context serve all its allocations from a caller owned memory region instead of its allocator hooks.
+ * Allocations are never released individually. When the region is exhausted the _ctx functions fail with -ERR_PP_CAPACITY
+ *
+ * ctx          Pointer to an initialized pp_ctx_t
+ * arena        Memory region aligned at least as malloc() would align it. NULL: back to the allocator hooks
+ * arena_size   Region's size
+ */
+void pp_ctx_set_arena(pp_ctx_t *ctx, void *arena, uint32_t arena_size);
+
+/* Makes the whole arena, or inline storage, available again. Everything allocated from it so far, headers and parsed TLVs, becomes invalid
+ *
+ * ctx  Pointer to an initialized pp_ctx_t
+ */
+void pp_ctx_reset_arena(pp_ctx_t *ctx);
+
+/* Releases a header created by pp_create_hdr_ctx() with the same context. A no-op for arena and inline storage allocations.
+ * Which one the header came from is told by its address, so a header from an arena must be released before the arena is replaced
+ *
+ * ctx  Pointer to the pp_ctx_t the header was created with
+ * ptr  The header
+ */
+void pp_ctx_free(pp_ctx_t *ctx, void *ptr);
+
+/* Same as pp_parse_hdr() and pp_create_hdr() but allocating through the context and updating its statistics.
+ * A parsed pp_info still has to be cleared with pp_info_clear() while the context is alive
+ *
+ * ctx  Pointer to an initialized pp_ctx_t. NULL: same as the plain functions
+ */
+int32_t pp_parse_hdr_ctx(pp_ctx_t *ctx, uint8_t *buffer, uint32_t buffer_length, pp_info_t *pp_info);
+uint8_t *pp_create_hdr_ctx(pp_ctx_t *ctx, uint8_t version, const pp_info_t *pp_info, uint16_t *pp_hdr_len, int32_t *error);
+
+/* Callbacks of pp_parse_hdr_cb(). Each one is optional. They return ERR_NULL to go on or < 0 to abort the parsing, which then returns this value */
+typedef struct
+{
+    /* version  1 or 2
+     * local    1: LOCAL 0: PROXY. Always 0 for v1
+     */
+    int32_t (*on_hdr)(uint8_t version, uint8_t local, uint8_t address_family, uint8_t transport_protocol, void *user_data);
+    /* Binary addresses in network byte order: 4 bytes for ADDR_FAMILY_INET, 16 for ADDR_FAMILY_INET6 and the 108 bytes
+     * path fields for ADDR_FAMILY_UNIX. Not called without addresses
+     */
+    int32_t (*on_addrs)(uint8_t address_family, const uint8_t *src_addr, const uint8_t *dst_addr, uint16_t addr_len, void *user_data);
+    /* Host byte order. Only for ADDR_FAMILY_INET and ADDR_FAMILY_INET6 */
+    int32_t (*on_ports)(uint16_t src_port, uint16_t dst_port, void *user_data);
+    /* Every top level TLV in order, NOOP included. The value points into the parsed buffer */
+    int32_t (*on_tlv)(uint8_t type, const uint8_t *value, uint16_t length, void *user_data);
+} pp_parse_cb_t;
+
+/* Parses a PROXY protocol header handing every field to the callbacks as it goes, without filling a pp_info_t and without allocating.
+ * Only the framing of the TLVs is validated, apart from the PP2_TYPE_CRC32C checksum which is verified once all of them are passed.
+ * Whatever the callbacks received must be discarded if an error is returned
+ *
+ * buffer           Buffer starting with the PROXY protocol header
+ * buffer_length    Buffer's length
+ * cb               The callbacks
+ * user_data        Passed to the callbacks as is
+ * return           >  0 Length of the PROXY protocol header
+ *                  == 0 No PROXY protocol header found
+ *                  <  0 Error occurred
+ */
+int32_t pp_parse_hdr_cb(const uint8_t *buffer, uint32_t buffer_length, const pp_parse_cb_t *cb, void *user_data);
+
+/* Verifies the checksum whose verification PP_CTX_F_CRC32C_DEFERRED deferred, e.g. on a sample of the connections
+ *
+ * pp_info          Pointer to the pp_info_t filled by pp_parse_hdr_ctx(). Its pp2_info.crc32c becomes 1 on success.
+ *                  A checksum accepted through PP_CTX_F_CRC32C_SKIP can be verified too. Calculated with the crc32c_engine
+ *                  of the context it was parsed with
+ * buffer           The same header bytes that were parsed
+ * buffer_length    Buffer's length
+ * return           ERR_NULL: verified or there was nothing to verify (no checksum or already verified)
+ *                  < 0 Error occurred. -ERR_PP2_TYPE_CRC32C: mismatch
+ */
+int32_t pp_info_verify_crc32c(pp_info_t *pp_info, const uint8_t *buffer, uint32_t buffer_length);
+
+/* Verifies the PP2_TYPE_CRC32C checksum of a v2 PROXY protocol header, located by the header's framing alone.
+ * Neither addresses nor other TLVs are decoded and nothing is allocated. Meant for middleboxes passing the bytes through
+ *
+ * hdr      Buffer starting with the v2 PROXY protocol header
+ * len      Buffer's length
+ * return   >  0 Length of the header. Its checksum matched
+ *          == 0 The header carries no PP2_TYPE_CRC32C TLV
+ *          <  0 Error occurred. -ERR_PP2_TYPE_CRC32C: mismatch, malformed or repeated PP2_TYPE_CRC32C TLV
+ */
+int32_t pp2_verify_crc32c(const uint8_t *hdr, uint32_t len);
+
+/* Views of the AF_UNIX source and destination paths of a v2 PROXY protocol header, pointing straight into its bytes.
+ * Only the header's framing is looked at
+ *
+ * hdr      Buffer starting with the v2 PROXY protocol header
+ * len      Buffer's length
+ * src      Pointer which will be set to the source path
+ * src_len  Pointer to a uint16_t where the source path's length up to its NULL terminator will be set.
+ *          108: the path fills the whole field and is not terminated
+ * dst      Same as src for the destination path
+ * dst_len  Same as src_len for the destination path
+ * return   > 0 Length of the header
+ *          < 0 Error occurred. -ERR_PP2_ADDR_FAMILY: not an AF_UNIX header
+ */
+int32_t pp2_get_unix_addrs(const uint8_t *hdr, uint32_t len, const uint8_t **src, uint16_t *src_len, const uint8_t **dst, uint16_t *dst_len);
+
+/* Batch forms for e.g. the datagrams of one recvmmsg(). Each element gets the same result as the single header function would give it.
+ * The PP2_TYPE_CRC32C checksums of the whole batch are calculated together, several headers interleaved, which is faster than one by one
+ *
+ * ctx      Pointer to an initialized pp_ctx_t. NULL: the standard allocator.
+ *          With PP_CTX_F_NO_HEAP and no arena, the TLVs of all the parsed elements share the one inline storage of
+ *          PP_CTX_INLINE_STORAGE_SIZE bytes and stay valid only until the next parsing with the context
+ * count    Number of elements of every array
+ * return   Number of elements which succeeded: verified checksums, parsed headers, created headers
+ */
+uint32_t pp2_verify_crc32c_batch(const uint8_t *const *hdrs, const uint32_t *lens, uint32_t count, int32_t *results);
+uint32_t pp_parse_hdr_batch(pp_ctx_t *ctx, uint8_t *const *buffers, const uint32_t *buffer_lengths, uint32_t count, pp_info_t *pp_infos, int32_t *results);
+uint32_t pp2_create_hdr_batch(pp_ctx_t *ctx, const pp_info_t *pp_infos, uint32_t count, uint8_t **pp2_hdrs, uint16_t *pp2_hdr_lens, int32_t *results);
+
+/* Parses the v2 PROXY protocol header which prefixes a single datagram, e.g. of a QUIC or DNS flow.
+ * Only v2 applies to datagrams: a datagram not starting with the v2 signature is all payload.
+ * A header must be complete within its datagram, declare TRANSPORT_PROTOCOL_DGRAM, or be a LOCAL one
+ *
+ * ctx              Pointer to an initialized pp_ctx_t. NULL: the standard allocator
+ * datagram         The whole datagram as received
+ * datagram_length  Datagram's length
+ * pp_info          Pointer to a pp_info_t structure which will get filled. Clear it with pp_info_clear() as after pp_parse_hdr()
+ * return           >  0 Length of the header i.e. offset of the payload
+ *                  == 0 No PROXY protocol header. The payload starts at offset 0
+ *                  <  0 Error occurred. The datagram should be dropped
+ */
+int32_t pp_parse_dgram_hdr(pp_ctx_t *ctx, uint8_t *datagram, uint32_t datagram_length, pp_info_t *pp_info);
+
+/* Lays out outbound datagrams as a cached header followed by their payloads without copying either, e.g. for sendmmsg().
+ * The i-th datagram is sent with msg_iov = &iovs[2 * i] and msg_iovlen = 2. Not available on Windows
+ *
+ * pp_hdr       Header shared by the datagrams, typically created once per flow. It must stay valid until they are sent
+ * pp_hdr_len   Header's length
+ * payloads     count iovecs, one payload each
+ * count        Number of datagrams
+ * iovs         2 * count iovecs to be filled in: the header and the payload of each datagram
+ */
+#ifndef _WIN32
+void pp_dgram_iov_prepend(const uint8_t *pp_hdr, uint16_t pp_hdr_len, const struct iovec *payloads, uint32_t count, struct iovec *iovs);
+#endif
+
+/* Converts a received v1 PROXY protocol header into the equivalent v2 one or a v2 into the equivalent v1, directly from their bytes.
+ * v1 to v2: UNKNOWN becomes LOCAL, AF_UNSPEC. The builder's TLVs and pp2_info options (crc32c, alignment_power) are applied.
+ *           The builder's pp_info address_family, transport_protocol, src_addr, dst_addr, src_port and dst_port are overwritten with the v1 ones
+ * v2 to v1: LOCAL, AF_UNSPEC, AF_UNIX and datagrams become UNKNOWN. An invalid command or transport protocol fails with
+ *           -ERR_PP2_CMD or -ERR_PP2_TRANSPORT_PROTOCOL as in pp_parse_hdr(). The TLVs are neither validated nor carried over.
+ *           The builder is left as it is
+ *
+ * builder          Pointer to an initialized pp_builder_t whose buffer will hold the converted header
+ * buffer           Buffer starting with the received PROXY protocol header
+ * buffer_length    Buffer's length
+ * pp_hdr           Pointer which will be set to the converted header. Owned by the builder
+ * pp_hdr_len       Pointer to a uint16_t where the length of the converted header will be set
+ * return           >  0 Length of the received PROXY protocol header
+ *                  == 0 No PROXY protocol header found
+ *                  <  0 Error occurred
+ */
+int32_t pp_transcode(pp_builder_t *builder, const uint8_t *buffer, uint32_t buffer_length, const uint8_t **pp_hdr, uint16_t *pp_hdr_len);
+
 #endif
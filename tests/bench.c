@@ -0,0 +1,253 @@
+/*
+ * libproxyprotocol is an ANSI C library to parse and create PROXY protocol v1 and v2 headers
+ * Copyright (C) 2022  Kosmas Valianos (kosmas.valianos@gmail.com)
+ *
+ * The libproxyprotocol library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The libproxyprotocol library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Throughput scaling benchmark of pp_parse_hdr() and pp_create_hdr().
+ * Every thread count from 1 up to the maximum runs both operations over the same read only corpus
+ * and the per-thread and aggregate throughput are reported. An aggregate that stops growing with
+ * the threads points to contention in the allocator, false sharing or shared tables.
+ *
+ * Usage: bench_libproxyprotocol [max_threads (default: online CPUs)] [seconds per run (default: 1)]
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/proxy_protocol.h"
+
+#define NUM_ELEMS(array) (uint32_t)(sizeof(array) / sizeof(array[0]))
+#define MAX_THREADS      1024
+#define CACHE_LINE       64
+
+typedef struct
+{
+    uint8_t *hdr;
+    uint16_t hdr_len;
+} corpus_hdr_t;
+
+typedef enum
+{
+    BENCH_PARSE,
+    BENCH_CREATE
+} bench_op_t;
+
+/* Each thread writes its results only to its own cache line */
+typedef union
+{
+    struct
+    {
+        uint64_t ops;
+        double   seconds;
+        uint8_t  failed;
+    } result;
+    uint8_t pad[CACHE_LINE];
+} thread_result_t;
+
+typedef struct
+{
+    bench_op_t         op;
+    double             seconds;
+    pthread_barrier_t *barrier;
+    thread_result_t   *result;
+} thread_arg_t;
+
+/* Shared read only corpus */
+static corpus_hdr_t corpus[5];
+
+static const pp_info_t pp_info_ipv4 = {
+    .address_family = ADDR_FAMILY_INET,
+    .transport_protocol = TRANSPORT_PROTOCOL_STREAM,
+    .src_addr = "192.168.10.100",
+    .dst_addr = "192.168.11.90",
+    .src_port = 42332,
+    .dst_port = 8080
+};
+
+static const pp_info_t pp_info_ipv6 = {
+    .address_family = ADDR_FAMILY_INET6,
+    .transport_protocol = TRANSPORT_PROTOCOL_STREAM,
+    .src_addr = "2001:db8:85a3::8a2e:370:7334",
+    .dst_addr = "2001:db8:85a3::8a2e:370:7335",
+    .src_port = 42332,
+    .dst_port = 443,
+    .pp2_info = { .crc32c = 1 }
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The header creation the way a proxy does it per connection: fill the info, add the TLVs, create */
+static uint8_t *create_hdr(uint8_t version, const pp_info_t *pp_info_template, uint8_t tlvs, uint16_t *pp_hdr_len)
+{
+    pp_info_t pp_info = *pp_info_template;
+    int32_t error;
+    if (tlvs
+        && (!pp_info_add_authority(&pp_info, 15, (const uint8_t*) "example.com:443")
+            || !pp_info_add_unique_id(&pp_info, 16, (const uint8_t*) "0123456789abcdef")
+            || !pp_info_add_ssl(&pp_info, "TLSv1.3", "TLS_AES_128_GCM_SHA256", "SHA256", "RSA2048", (const uint8_t*) "example.com", 11)))
+    {
+        pp_info_clear(&pp_info);
+        return NULL;
+    }
+    uint8_t *pp_hdr = pp_create_hdr(version, &pp_info, pp_hdr_len, &error);
+    pp_info_clear(&pp_info);
+    return pp_hdr;
+}
+
+static void *bench_thread(void *arg)
+{
+    thread_arg_t *thread_arg = (thread_arg_t*) arg;
+    uint64_t ops = 0;
+    uint8_t failed = 0;
+    uint32_t i;
+
+    pthread_barrier_wait(thread_arg->barrier);
+    double start = now();
+    double elapsed = 0;
+    while (!failed && elapsed < thread_arg->seconds)
+    {
+        /* Check the clock only every so often */
+        for (i = 0; i < 1024 && !failed; i++)
+        {
+            if (thread_arg->op == BENCH_PARSE)
+            {
+                const corpus_hdr_t *corpus_hdr = &corpus[i % NUM_ELEMS(corpus)];
+                pp_info_t pp_info;
+                failed = pp_parse_hdr(corpus_hdr->hdr, corpus_hdr->hdr_len, &pp_info) != corpus_hdr->hdr_len;
+                pp_info_clear(&pp_info);
+            }
+            else
+            {
+                uint16_t pp_hdr_len;
+                uint8_t *pp_hdr = create_hdr(i & 1 ? 1 : 2, i & 2 ? &pp_info_ipv6 : &pp_info_ipv4, i & 1 ? 0 : 1, &pp_hdr_len);
+                failed = !pp_hdr;
+                free(pp_hdr);
+            }
+        }
+        ops += i;
+        elapsed = now() - start;
+    }
+
+    thread_arg->result->result.ops = ops;
+    thread_arg->result->result.seconds = elapsed;
+    thread_arg->result->result.failed = failed;
+    return NULL;
+}
+
+static uint8_t bench_run(bench_op_t op, uint32_t threads, double seconds, double *aggregate_ops)
+{
+    static thread_result_t results[MAX_THREADS];
+    static thread_arg_t thread_args[MAX_THREADS];
+    static pthread_t thread_ids[MAX_THREADS];
+    pthread_barrier_t barrier;
+    uint32_t i;
+
+    memset(results, 0, sizeof(results));
+    pthread_barrier_init(&barrier, NULL, threads);
+    for (i = 0; i < threads; i++)
+    {
+        thread_args[i].op = op;
+        thread_args[i].seconds = seconds;
+        thread_args[i].barrier = &barrier;
+        thread_args[i].result = &results[i];
+        if (pthread_create(&thread_ids[i], NULL, bench_thread, &thread_args[i]))
+        {
+            fprintf(stderr, "pthread_create() failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    uint8_t failed = 0;
+    *aggregate_ops = 0;
+    printf("%-6s threads %4u:", op == BENCH_PARSE ? "parse" : "create", threads);
+    for (i = 0; i < threads; i++)
+    {
+        pthread_join(thread_ids[i], NULL);
+        double ops = results[i].result.ops / results[i].result.seconds;
+        *aggregate_ops += ops;
+        failed = failed || results[i].result.failed;
+        printf(" %.2f", ops / 1e6);
+    }
+    pthread_barrier_destroy(&barrier);
+    return !failed;
+}
+
+int main(int argc, char *argv[])
+{
+    long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t max_threads = argc > 1 ? strtoul(argv[1], NULL, 10) : (online_cpus > 0 ? online_cpus : 1);
+    double seconds = argc > 2 ? strtod(argv[2], NULL) : 1;
+    if (!max_threads || max_threads > MAX_THREADS || seconds <= 0)
+    {
+        fprintf(stderr, "Usage: %s [max_threads 1..%u] [seconds per run]\n", argv[0], MAX_THREADS);
+        return EXIT_FAILURE;
+    }
+
+    /* v1 and v2, IPv4 and IPv6, with and without TLVs and CRC32c */
+    corpus[0].hdr = create_hdr(1, &pp_info_ipv4, 0, &corpus[0].hdr_len);
+    corpus[1].hdr = create_hdr(1, &pp_info_ipv6, 0, &corpus[1].hdr_len);
+    corpus[2].hdr = create_hdr(2, &pp_info_ipv4, 0, &corpus[2].hdr_len);
+    corpus[3].hdr = create_hdr(2, &pp_info_ipv4, 1, &corpus[3].hdr_len);
+    corpus[4].hdr = create_hdr(2, &pp_info_ipv6, 1, &corpus[4].hdr_len);
+    uint32_t i;
+    for (i = 0; i < NUM_ELEMS(corpus); i++)
+    {
+        if (!corpus[i].hdr)
+        {
+            fprintf(stderr, "Corpus creation failed\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("Per-thread and aggregate throughput in Mops/s. Efficiency: aggregate / (threads * single thread)\n");
+    bench_op_t op;
+    for (op = BENCH_PARSE; op <= BENCH_CREATE; op++)
+    {
+        double single_thread_ops = 0;
+        uint32_t threads;
+        for (threads = 1; threads <= max_threads; threads++)
+        {
+            double aggregate_ops;
+            if (!bench_run(op, threads, seconds, &aggregate_ops))
+            {
+                printf("\nFAILED\n");
+                return EXIT_FAILURE;
+            }
+            if (threads == 1)
+            {
+                single_thread_ops = aggregate_ops;
+            }
+            printf(" | aggregate %.2f efficiency %.0f%%\n", aggregate_ops / 1e6, 100 * aggregate_ops / (threads * single_thread_ops));
+        }
+    }
+
+    for (i = 0; i < NUM_ELEMS(corpus); i++)
+    {
+        free(corpus[i].hdr);
+    }
+    return EXIT_SUCCESS;
+}
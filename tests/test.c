@@ -24,12 +24,94 @@
     #pragma comment(lib, "ws2_32.lib")
 #else
     #include <arpa/inet.h>
+    #include <sys/socket.h>
+    #include <sys/uio.h>
+    #include <unistd.h>
 #endif
 
 #include "../src/proxy_protocol.h"
 
 #define NUM_ELEMS(array) (uint32_t)(sizeof(array) / sizeof(array[0]))
 
+/* Allocation counting through malloc()/calloc()/realloc()/free() interposition. The library's allocations resolve to
+ * the ones below. Bytes are the usable sizes the allocator handed out. Only available with glibc and without AddressSanitizer
+ */
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+#include <malloc.h>
+
+#define ALLOC_COUNTING
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void  __libc_free(void *ptr);
+
+typedef struct
+{
+    uint8_t  enabled;
+    uint32_t allocations;
+    int64_t  bytes;
+    int64_t  peak_bytes;
+} alloc_stats_t;
+
+static alloc_stats_t alloc_stats;
+
+static void alloc_stats_start(void)
+{
+    memset(&alloc_stats, 0, sizeof(alloc_stats));
+    alloc_stats.enabled = 1;
+}
+
+static void alloc_stats_stop(void)
+{
+    alloc_stats.enabled = 0;
+}
+
+static void alloc_stats_record(void *ptr, size_t old_usable_size)
+{
+    if (alloc_stats.enabled && ptr)
+    {
+        alloc_stats.allocations++;
+        alloc_stats.bytes += malloc_usable_size(ptr) - old_usable_size;
+        if (alloc_stats.bytes > alloc_stats.peak_bytes)
+        {
+            alloc_stats.peak_bytes = alloc_stats.bytes;
+        }
+    }
+}
+
+void *malloc(size_t size)
+{
+    void *ptr = __libc_malloc(size);
+    alloc_stats_record(ptr, 0);
+    return ptr;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *ptr = __libc_calloc(nmemb, size);
+    alloc_stats_record(ptr, 0);
+    return ptr;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    size_t old_usable_size = ptr ? malloc_usable_size(ptr) : 0;
+    void *new_ptr = __libc_realloc(ptr, size);
+    alloc_stats_record(new_ptr, old_usable_size);
+    return new_ptr;
+}
+
+void free(void *ptr)
+{
+    if (alloc_stats.enabled && ptr)
+    {
+        alloc_stats.bytes -= malloc_usable_size(ptr);
+    }
+    __libc_free(ptr);
+}
+#endif
+
 /* Type-Length-Value (TLV vectors) */
 /* They need to be defined, for tests purposes, as the API does not expose them */
 #define PP2_TYPE_ALPN           0x01
@@ -85,8 +167,8 @@ uint8_t pp2_hdr_vpce[] = {
             0xc0, 0xa8, 0x0a, 0x64, /* Source IP */
             0xc0, 0xa8, 0x0b, 0x5a, /* Destination IP */
             0xa5, 0x5c, 0x1f, 0x90, /* Source port, Destination port */
-            0x03, 0x00, 0x04, 0xe5, /* CRC32C TLV start */
-            0x18, 0x86, 0xf8, 0xea, /* CRC32C TLV end, AWS VPCE ID TLV start */
+            0x03, 0x00, 0x04, 0xf8, /* CRC32C TLV start */
+            0x86, 0x18, 0xe5, 0xea, /* CRC32C TLV end, AWS VPCE ID TLV start */
             0x00, 0x17, 0x01, 0x76,
             0x70, 0x63, 0x65, 0x2d,
             0x32, 0x33, 0x64, 0x38,
@@ -307,6 +389,204 @@ static uint8_t pp_info_equal(const pp_info_t *pp_info_a, const pp_info_t *pp_inf
     return 1;
 }
 
+static uint32_t test_realloc_calls;
+static uint32_t test_free_calls;
+
+static void *test_realloc(void *ptr, size_t size)
+{
+    test_realloc_calls++;
+    return realloc(ptr, size);
+}
+
+static void test_free(void *ptr)
+{
+    test_free_calls++;
+    free(ptr);
+}
+
+/* Application TLV handler decoding into its own struct */
+typedef struct
+{
+    uint32_t calls;
+    uint8_t  type;
+    uint8_t  value[32];
+    uint16_t length;
+} test_tlv_decoded_t;
+
+static int32_t test_tlv_handler(uint8_t type, const uint8_t *value, uint16_t length, pp_info_t *pp_info, void *user_data)
+{
+    test_tlv_decoded_t *decoded = (test_tlv_decoded_t*) user_data;
+    (void) pp_info;
+    decoded->calls++;
+    decoded->type = type;
+    decoded->length = length < sizeof(decoded->value) ? length : sizeof(decoded->value);
+    memcpy(decoded->value, value, decoded->length);
+    return length ? ERR_NULL : -1000;
+}
+
+/* pp_parse_hdr_cb() callbacks recording what they are handed */
+typedef struct
+{
+    uint8_t  version;
+    uint8_t  local;
+    uint8_t  address_family;
+    uint8_t  transport_protocol;
+    uint8_t  src_addr[16];
+    uint8_t  dst_addr[16];
+    uint16_t addr_len;
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint32_t tlvs;
+    uint8_t  last_tlv_type;
+    int32_t  abort_tlvs;
+} test_parse_cb_t;
+
+static int32_t test_on_hdr(uint8_t version, uint8_t local, uint8_t address_family, uint8_t transport_protocol, void *user_data)
+{
+    test_parse_cb_t *parsed = (test_parse_cb_t*) user_data;
+    parsed->version = version;
+    parsed->local = local;
+    parsed->address_family = address_family;
+    parsed->transport_protocol = transport_protocol;
+    return ERR_NULL;
+}
+
+static int32_t test_on_addrs(uint8_t address_family, const uint8_t *src_addr, const uint8_t *dst_addr, uint16_t addr_len, void *user_data)
+{
+    test_parse_cb_t *parsed = (test_parse_cb_t*) user_data;
+    (void) address_family;
+    parsed->addr_len = addr_len;
+    memcpy(parsed->src_addr, src_addr, addr_len < sizeof(parsed->src_addr) ? addr_len : sizeof(parsed->src_addr));
+    memcpy(parsed->dst_addr, dst_addr, addr_len < sizeof(parsed->dst_addr) ? addr_len : sizeof(parsed->dst_addr));
+    return ERR_NULL;
+}
+
+static int32_t test_on_ports(uint16_t src_port, uint16_t dst_port, void *user_data)
+{
+    test_parse_cb_t *parsed = (test_parse_cb_t*) user_data;
+    parsed->src_port = src_port;
+    parsed->dst_port = dst_port;
+    return ERR_NULL;
+}
+
+static int32_t test_on_tlv(uint8_t type, const uint8_t *value, uint16_t length, void *user_data)
+{
+    test_parse_cb_t *parsed = (test_parse_cb_t*) user_data;
+    (void) value;
+    (void) length;
+    parsed->tlvs++;
+    parsed->last_tlv_type = type;
+    return parsed->abort_tlvs && parsed->tlvs == (uint32_t) parsed->abort_tlvs ? -1000 : ERR_NULL;
+}
+
+static const pp_parse_cb_t test_parse_cb = { test_on_hdr, test_on_addrs, test_on_ports, test_on_tlv };
+
+#ifdef ALLOC_COUNTING
+typedef enum
+{
+    ALLOC_OP_PARSE,
+    ALLOC_OP_PARSE_CB,
+    ALLOC_OP_CREATE_V1,
+    ALLOC_OP_CREATE_V2,
+    ALLOC_OP_BUILDER,
+    ALLOC_OP_TLV_ITER,
+    ALLOC_OP_FORWARD,
+    ALLOC_OP_TRANSCODE,
+    ALLOC_OP_VERIFY_CRC32C
+} alloc_op_t;
+
+/* Golden allocation budget of an operation. Going over it is a regression */
+typedef struct
+{
+    const char *name;
+    alloc_op_t  op;
+    uint8_t    *raw_bytes_in;
+    uint32_t    raw_bytes_in_length;
+    uint32_t    max_allocations;
+    int64_t     max_peak_bytes;
+} alloc_budget_t;
+
+/* Runs the budget's operation and leaves its allocations in alloc_stats.
+ * The operations meant to be allocation free in steady state are warmed up first
+ */
+static uint8_t alloc_budget_run(const alloc_budget_t *budget)
+{
+    pp_info_t pp_info_in = {
+        .address_family = ADDR_FAMILY_INET,
+        .transport_protocol = TRANSPORT_PROTOCOL_STREAM,
+        .src_addr = "192.168.10.100",
+        .dst_addr = "192.168.11.90",
+        .src_port = 42332,
+        .dst_port = 8080,
+        .pp2_info = { .crc32c = 1 }
+    };
+    pp_info_t pp_info;
+    test_parse_cb_t parsed;
+    pp_builder_t builder;
+    pp_tlv_iter_t iter;
+    uint8_t out[512];
+    const uint8_t *pp_hdr_const = NULL;
+    uint8_t *pp_hdr = NULL;
+    uint16_t pp_hdr_len = 0;
+    int32_t error = ERR_NULL;
+    uint8_t round, ok = 1;
+
+    memset(&parsed, 0, sizeof(parsed));
+    pp_builder_init(&builder);
+    for (round = 0; round < 2 && ok; round++)
+    {
+        /* Only the second round of the warmed up operations counts */
+        if (round == 1 || (budget->op != ALLOC_OP_BUILDER && budget->op != ALLOC_OP_TRANSCODE))
+        {
+            alloc_stats_start();
+        }
+        switch (budget->op)
+        {
+        case ALLOC_OP_PARSE:
+            ok = pp_parse_hdr(budget->raw_bytes_in, budget->raw_bytes_in_length, &pp_info) == (int32_t) budget->raw_bytes_in_length;
+            pp_info_clear(&pp_info);
+            break;
+        case ALLOC_OP_PARSE_CB:
+            ok = pp_parse_hdr_cb(budget->raw_bytes_in, budget->raw_bytes_in_length, &test_parse_cb, &parsed) == (int32_t) budget->raw_bytes_in_length;
+            break;
+        case ALLOC_OP_CREATE_V1:
+        case ALLOC_OP_CREATE_V2:
+            pp_hdr = pp_create_hdr(budget->op == ALLOC_OP_CREATE_V1 ? 1 : 2, &pp_info_in, &pp_hdr_len, &error);
+            ok = pp_hdr != NULL;
+            free(pp_hdr);
+            break;
+        case ALLOC_OP_BUILDER:
+            pp_builder_reset(&builder);
+            builder.pp_info = pp_info_in;
+            ok = pp_builder_add_ssl(&builder, "TLSv1.2", 7, NULL, 0, NULL, 0, NULL, 0, (const uint8_t*) "example.com", 11)
+              && pp_builder_create_hdr(&builder, 2, &pp_hdr_len, &error);
+            break;
+        case ALLOC_OP_TLV_ITER:
+            ok = pp_tlv_iter_init(&iter, budget->raw_bytes_in, budget->raw_bytes_in_length) > 0;
+            while (ok && pp_tlv_iter_next(&iter));
+            ok = ok && iter.error == ERR_NULL;
+            break;
+        case ALLOC_OP_FORWARD:
+            ok = pp2_forward_hdr(budget->raw_bytes_in, budget->raw_bytes_in_length, NULL, NULL, 0, PP2_FORWARD_F_CRC32C, out, sizeof(out)) > 0;
+            break;
+        case ALLOC_OP_TRANSCODE:
+            ok = pp_transcode(&builder, budget->raw_bytes_in, budget->raw_bytes_in_length, &pp_hdr_const, &pp_hdr_len) > 0;
+            break;
+        case ALLOC_OP_VERIFY_CRC32C:
+            ok = pp2_verify_crc32c(budget->raw_bytes_in, budget->raw_bytes_in_length) > 0;
+            break;
+        }
+        alloc_stats_stop();
+        if (budget->op != ALLOC_OP_BUILDER && budget->op != ALLOC_OP_TRANSCODE)
+        {
+            break;
+        }
+    }
+    pp_builder_free(&builder);
+    return ok;
+}
+#endif
+
 int main()
 {
     /* Define tests */
@@ -341,7 +621,7 @@ int main()
                 {
                     .type = PP2_TYPE_CRC32C,
                     .value_len = 4,
-                    .value = (uint8_t*) "\xe5\x18\x86\xf8"
+                    .value = (uint8_t*) "\xf8\x86\x18\xe5"
                 },
                 {
                     .type = PP2_TYPE_AWS,
@@ -482,7 +762,7 @@ int main()
                 {
                     .type = PP2_TYPE_CRC32C,
                     .value_len = 4,
-                    .value = (uint8_t*)"\x43\x84\x86\x4e"
+                    .value = (uint8_t*)"\x4e\x86\x84\x43"
                 },
             },
             .pp_info_out_expected = tests[9].pp_info_in,
@@ -690,6 +970,9 @@ int main()
         printf("Running test: %s...", tests[i].name);
         pp_info_t pp_info_out;
         int32_t pp_parse_hdr_rc = 0;
+#ifdef ALLOC_COUNTING
+        alloc_stats_start();
+#endif
         if (tests[i].raw_bytes_in)
         {
             pp_parse_hdr_rc = pp_parse_hdr(tests[i].raw_bytes_in, tests[i].raw_bytes_in_length, &pp_info_out);
@@ -754,20 +1037,1321 @@ int main()
             return EXIT_FAILURE;
         }
         pp_info_clear(&pp_info_out);
+#ifdef ALLOC_COUNTING
+        alloc_stats_stop();
+        printf("PASSED (allocations: %u, peak bytes: %ld)\n", alloc_stats.allocations, (long) alloc_stats.peak_bytes);
+#else
         printf("PASSED\n");
+#endif
     }
 
     /* Test pp_strerror() */
     printf("Running test: pp_strerror()...");
     if (strcmp("No error", pp_strerror(ERR_NULL))
      || strcmp("v1 PROXY protocol header: invalid dst port", pp_strerror(-ERR_PP1_DST_PORT))
-     || pp_strerror(-29) || pp_strerror(1))
+     || strcmp("Fixed capacity storage exhausted", pp_strerror(-ERR_PP_CAPACITY))
+     || strcmp("v2 PROXY protocol header: too many TLVs", pp_strerror(-ERR_PP2_TLV_COUNT))
+     || pp_strerror(-32) || pp_strerror(1))
+    {
+        printf("FAILED\n");
+        return EXIT_FAILURE;
+    }
+    printf("PASSED\n");
+
+    /* Test pp2_get_healthcheck_hdr() and pp2_is_healthcheck_hdr() */
+    printf("Running test: pp2_get_healthcheck_hdr(), pp2_is_healthcheck_hdr()...");
+    uint8_t c;
+    for (c = 0; c <= 1; c++)
+    {
+        pp_info_t pp_info_healthcheck = {
+            .address_family = ADDR_FAMILY_UNSPEC,
+            .transport_protocol = TRANSPORT_PROTOCOL_UNSPEC,
+            .pp2_info = { .local = 1, .crc32c = c }
+        };
+        uint16_t pp_hdr_len = 0, healthcheck_hdr_len = 0;
+        int32_t error = ERR_NULL;
+        uint8_t *pp_hdr = pp_create_hdr(2, &pp_info_healthcheck, &pp_hdr_len, &error);
+        const uint8_t *healthcheck_hdr = pp2_get_healthcheck_hdr(c, &healthcheck_hdr_len);
+        pp_info_t pp_info_out;
+        int32_t rc = pp_parse_hdr((uint8_t*) healthcheck_hdr, healthcheck_hdr_len, &pp_info_out);
+        uint8_t failed = !pp_hdr || pp_hdr_len != healthcheck_hdr_len || memcmp(pp_hdr, healthcheck_hdr, pp_hdr_len)
+            || pp2_is_healthcheck_hdr(healthcheck_hdr, healthcheck_hdr_len) != healthcheck_hdr_len
+            || pp2_is_healthcheck_hdr(healthcheck_hdr, healthcheck_hdr_len - 1) == healthcheck_hdr_len
+            || rc != healthcheck_hdr_len || !pp_info_out.pp2_info.local || pp_info_out.pp2_info.crc32c != c;
+        free(pp_hdr);
+        pp_info_clear(&pp_info_out);
+        if (failed)
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+    if (pp2_is_healthcheck_hdr(pp2_hdr_vpce, sizeof(pp2_hdr_vpce)))
     {
         printf("FAILED\n");
         return EXIT_FAILURE;
     }
     printf("PASSED\n");
 
+    /* Test that the checksum is serialized in network byte order whatever the host byte order:
+     * created, forwarded and constant healthcheck headers all carry the same bytes
+     */
+    printf("Running test: PP2_TYPE_CRC32C byte order...");
+    {
+        const uint32_t healthcheck_crc32c = 0xa9b87e8f;
+        const uint8_t expected[] = {
+            healthcheck_crc32c >> 24, (healthcheck_crc32c >> 16) & 0xff, (healthcheck_crc32c >> 8) & 0xff, healthcheck_crc32c & 0xff
+        };
+        pp_info_t pp_info_healthcheck = {
+            .address_family = ADDR_FAMILY_UNSPEC,
+            .transport_protocol = TRANSPORT_PROTOCOL_UNSPEC,
+            .pp2_info = { .local = 1, .crc32c = 1 }
+        };
+        uint16_t pp_hdr_len = 0, healthcheck_hdr_len = 0;
+        int32_t error = ERR_NULL;
+        uint8_t *pp_hdr = pp_create_hdr(2, &pp_info_healthcheck, &pp_hdr_len, &error);
+        const uint8_t *healthcheck_hdr = pp2_get_healthcheck_hdr(0, &healthcheck_hdr_len);
+        uint8_t out[64];
+        int32_t out_len = pp2_forward_hdr(healthcheck_hdr, healthcheck_hdr_len, NULL, NULL, 0, PP2_FORWARD_F_CRC32C, out, sizeof(out));
+        healthcheck_hdr = pp2_get_healthcheck_hdr(1, &healthcheck_hdr_len);
+        uint8_t failed = !pp_hdr || pp_hdr_len != healthcheck_hdr_len || out_len != healthcheck_hdr_len
+            || memcmp(pp_hdr + pp_hdr_len - sizeof(expected), expected, sizeof(expected))
+            || memcmp(out + out_len - sizeof(expected), expected, sizeof(expected))
+            || memcmp(healthcheck_hdr + healthcheck_hdr_len - sizeof(expected), expected, sizeof(expected))
+            || pp2_verify_crc32c(healthcheck_hdr, healthcheck_hdr_len) != healthcheck_hdr_len;
+        free(pp_hdr);
+        if (failed)
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+
+    /* Test pp_info_add_ssl_len() and pp_info_add_aws_vpce_id_len() */
+    printf("Running test: pp_info_add_ssl_len(), pp_info_add_aws_vpce_id_len()...");
+    {
+        pp_info_t pp_info_in = {
+            .address_family = ADDR_FAMILY_INET,
+            .transport_protocol = TRANSPORT_PROTOCOL_STREAM,
+            .src_addr = "192.168.10.100",
+            .dst_addr = "192.168.11.90",
+            .src_port = 42332,
+            .dst_port = 8080,
+            .pp2_info = {
+                .pp2_ssl_info = { .ssl = 1, .cert_in_session = 1 },
+                .crc32c = 1
+            }
+        };
+        uint16_t pp_hdr_len = 0, length = 0;
+        int32_t error = ERR_NULL;
+        /* Not NULL terminated values, no PP2_SUBTYPE_SSL_SIG_ALG */
+        if (!pp_info_add_ssl_len(&pp_info_in, "TLSv1.3xxx", 7, "TLS_AES_128_GCM_SHA256xxx", 22, NULL, 0, "RSA2048", 7, (const uint8_t*) "example.com", 11)
+            || !pp_info_add_aws_vpce_id_len(&pp_info_in, 22, "vpce-23d8ezjk38bchilm4xxx"))
+        {
+            printf("FAILED\n");
+            pp_info_clear(&pp_info_in);
+            return EXIT_FAILURE;
+        }
+        uint8_t *pp_hdr = pp_create_hdr(2, &pp_info_in, &pp_hdr_len, &error);
+        pp_info_clear(&pp_info_in);
+        pp_info_t pp_info_out;
+        int32_t rc = pp_hdr ? pp_parse_hdr(pp_hdr, pp_hdr_len, &pp_info_out) : 0;
+        free(pp_hdr);
+        const uint8_t *cn = rc > 0 ? pp_info_get_ssl_cn(&pp_info_out, &length) : NULL;
+        if (rc != pp_hdr_len || error != ERR_NULL
+            || !pp_info_out.pp2_info.pp2_ssl_info.ssl || pp_info_out.pp2_info.pp2_ssl_info.cert_in_connection
+            || !pp_info_out.pp2_info.pp2_ssl_info.cert_in_session || pp_info_out.pp2_info.pp2_ssl_info.cert_verified
+            || !cn || length != 11 || memcmp(cn, "example.com", 11)
+            || strcmp((const char*) pp_info_get_ssl_version(&pp_info_out, &length), "TLSv1.3")
+            || strcmp((const char*) pp_info_get_ssl_cipher(&pp_info_out, &length), "TLS_AES_128_GCM_SHA256")
+            || strcmp((const char*) pp_info_get_ssl_key_alg(&pp_info_out, &length), "RSA2048")
+            || pp_info_get_ssl_sig_alg(&pp_info_out, &length)
+            || strcmp((const char*) pp_info_get_aws_vpce_id(&pp_info_out, &length), "vpce-23d8ezjk38bchilm4"))
+        {
+            printf("FAILED\n");
+            pp_info_clear(&pp_info_out);
+            return EXIT_FAILURE;
+        }
+        pp_info_clear(&pp_info_out);
+    }
+    printf("PASSED\n");
+
+    /* Test pp_builder_t */
+    printf("Running test: pp_builder_create_hdr(), pp_builder_reset()...");
+    {
+        pp_builder_t builder;
+        pp_builder_init(&builder);
+        const uint8_t *first_hdr = NULL;
+        uint8_t round;
+        for (round = 0; round < 3; round++)
+        {
+            pp_info_t pp_info_in = {
+                .address_family = ADDR_FAMILY_INET,
+                .transport_protocol = TRANSPORT_PROTOCOL_STREAM,
+                .src_addr = "192.168.10.100",
+                .dst_addr = "192.168.11.90",
+                .src_port = 42332,
+                .dst_port = 8080,
+                .pp2_info = {
+                    .alignment_power = 3,
+                    .pp2_ssl_info = { .ssl = 1, .cert_verified = 1 },
+                    .crc32c = 1
+                }
+            };
+            builder.pp_info = pp_info_in;
+            uint16_t pp_hdr_len = 0, builder_hdr_len = 0;
+            int32_t error = ERR_NULL, builder_error = ERR_NULL;
+            uint8_t failed = !pp_builder_add_ssl(&builder, "TLSv1.2", 7, NULL, 0, NULL, 0, NULL, 0, (const uint8_t*) "example.com", 11)
+                          || !pp_builder_add_unique_id(&builder, 4, (const uint8_t*) "\x01\x02\x03\x04")
+                          || !pp_info_add_ssl(&pp_info_in, "TLSv1.2", NULL, NULL, NULL, (const uint8_t*) "example.com", 11)
+                          || !pp_info_add_unique_id(&pp_info_in, 4, (const uint8_t*) "\x01\x02\x03\x04");
+            const uint8_t *builder_hdr = pp_builder_create_hdr(&builder, 2, &builder_hdr_len, &builder_error);
+            uint8_t *pp_hdr = pp_create_hdr(2, &pp_info_in, &pp_hdr_len, &error);
+            pp_info_clear(&pp_info_in);
+            failed = failed || !builder_hdr || !pp_hdr || builder_error != ERR_NULL || builder_hdr_len != pp_hdr_len
+                  || memcmp(builder_hdr, pp_hdr, pp_hdr_len) || (first_hdr && first_hdr != builder_hdr);
+            free(pp_hdr);
+            first_hdr = builder_hdr;
+            pp_builder_reset(&builder);
+            if (failed)
+            {
+                printf("FAILED\n");
+                pp_builder_free(&builder);
+                return EXIT_FAILURE;
+            }
+        }
+        pp_builder_free(&builder);
+    }
+    printf("PASSED\n");
+
+    /* Test the v1 line formatting */
+    printf("Running test: v1 PROXY protocol header: line formatting...");
+    {
+        struct
+        {
+            pp_info_t   pp_info;
+            const char *line;
+        } v1_lines[] = {
+            {
+                { .address_family = ADDR_FAMILY_INET, .src_addr = "0.0.0.0", .dst_addr = "255.255.255.255", .src_port = 0, .dst_port = 65535 },
+                "PROXY TCP4 0.0.0.0 255.255.255.255 0 65535\r\n"
+            },
+            {
+                { .address_family = ADDR_FAMILY_INET, .src_addr = "1.20.100.9", .dst_addr = "10.0.99.199", .src_port = 9, .dst_port = 10000 },
+                "PROXY TCP4 1.20.100.9 10.0.99.199 9 10000\r\n"
+            },
+            {
+                { .address_family = ADDR_FAMILY_INET6, .src_addr = "::", .dst_addr = "::1", .src_port = 10, .dst_port = 443 },
+                "PROXY TCP6 :: ::1 10 443\r\n"
+            },
+            {
+                { .address_family = ADDR_FAMILY_INET6, .src_addr = "2001:DB8:0:0:1:0:0:1", .dst_addr = "::ffff:10.0.0.1", .src_port = 99, .dst_port = 100 },
+                "PROXY TCP6 2001:db8::1:0:0:1 ::ffff:10.0.0.1 99 100\r\n"
+            },
+            {
+                { .address_family = ADDR_FAMILY_INET6, .src_addr = "fe80::", .dst_addr = "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff", .src_port = 1, .dst_port = 65535 },
+                "PROXY TCP6 fe80:: ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff 1 65535\r\n"
+            },
+        };
+        for (i = 0; i < NUM_ELEMS(v1_lines); i++)
+        {
+            uint16_t pp_hdr_len = 0;
+            int32_t error = ERR_NULL;
+            uint8_t *pp_hdr = pp_create_hdr(1, &v1_lines[i].pp_info, &pp_hdr_len, &error);
+            uint8_t failed = !pp_hdr || pp_hdr_len != strlen(v1_lines[i].line) || memcmp(pp_hdr, v1_lines[i].line, pp_hdr_len);
+            free(pp_hdr);
+            if (failed)
+            {
+                printf("FAILED\n");
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    printf("PASSED\n");
+
+    /* Test pp_create_hdr_from_sockaddr() */
+    printf("Running test: pp_create_hdr_from_sockaddr()...");
+    {
+        struct sockaddr_in src_in = { .sin_family = AF_INET, .sin_port = htons(42332) };
+        struct sockaddr_in dst_in = { .sin_family = AF_INET, .sin_port = htons(8080) };
+        struct sockaddr_in6 src_in6 = { .sin6_family = AF_INET6, .sin6_port = htons(51442) };
+        struct sockaddr_in6 dst_in6 = { .sin6_family = AF_INET6, .sin6_port = htons(80) };
+        inet_pton(AF_INET, "192.168.10.100", &src_in.sin_addr);
+        inet_pton(AF_INET, "192.168.11.90", &dst_in.sin_addr);
+        inet_pton(AF_INET6, "fd00:dead:beef::2", &src_in6.sin6_addr);
+        inet_pton(AF_INET6, "fd00:beef:dead::3", &dst_in6.sin6_addr);
+        const struct sockaddr *srcs[] = { (struct sockaddr*) &src_in, (struct sockaddr*) &src_in6 };
+        const struct sockaddr *dsts[] = { (struct sockaddr*) &dst_in, (struct sockaddr*) &dst_in6 };
+        pp_info_t pp_infos[] = {
+            {
+                .address_family = ADDR_FAMILY_INET,
+                .transport_protocol = TRANSPORT_PROTOCOL_STREAM,
+                .src_addr = "192.168.10.100",
+                .dst_addr = "192.168.11.90",
+                .src_port = 42332,
+                .dst_port = 8080,
+                .pp2_info.crc32c = 1
+            },
+            {
+                .address_family = ADDR_FAMILY_INET6,
+                .transport_protocol = TRANSPORT_PROTOCOL_STREAM,
+                .src_addr = "fd00:dead:beef::2",
+                .dst_addr = "fd00:beef:dead::3",
+                .src_port = 51442,
+                .dst_port = 80,
+                .pp2_info.crc32c = 1
+            },
+        };
+        uint8_t failed = 0;
+        uint8_t version;
+        for (i = 0; i < NUM_ELEMS(pp_infos) && !failed; i++)
+        {
+            for (version = 1; version <= 2 && !failed; version++)
+            {
+                uint16_t pp_hdr_len = 0, sockaddr_hdr_len = 0;
+                int32_t error = ERR_NULL, sockaddr_error = ERR_NULL;
+                pp_info_t pp_info_sockaddr = { .transport_protocol = TRANSPORT_PROTOCOL_STREAM, .pp2_info.crc32c = 1 };
+                uint8_t *pp_hdr = pp_create_hdr(version, &pp_infos[i], &pp_hdr_len, &error);
+                uint8_t *sockaddr_hdr = pp_create_hdr_from_sockaddr(version, &pp_info_sockaddr, srcs[i], dsts[i], &sockaddr_hdr_len, &sockaddr_error);
+                failed = !pp_hdr || !sockaddr_hdr || sockaddr_error != ERR_NULL
+                      || pp_hdr_len != sockaddr_hdr_len || memcmp(pp_hdr, sockaddr_hdr, pp_hdr_len);
+                free(pp_hdr);
+                free(sockaddr_hdr);
+            }
+        }
+        /* Mixed families */
+        uint16_t pp_hdr_len = 0;
+        int32_t error = ERR_NULL;
+        if (failed
+            || pp_create_hdr_from_sockaddr(2, &pp_infos[0], srcs[0], dsts[1], &pp_hdr_len, &error) || error != -ERR_PP2_ADDR_FAMILY
+            || pp_create_hdr_from_sockaddr(1, &pp_infos[0], srcs[1], dsts[0], &pp_hdr_len, &error) || error != -ERR_PP1_TRANSPORT_FAMILY)
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+
+#ifndef _WIN32
+    /* Test pp_info_from_socket() */
+    printf("Running test: pp_info_from_socket()...");
+    {
+        int fds[2];
+        pp_info_t pp_info_socket;
+        memset(&pp_info_socket, 0, sizeof(pp_info_socket));
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+        uint8_t rc = pp_info_from_socket(fds[0], &pp_info_socket);
+        close(fds[0]);
+        close(fds[1]);
+        if (!rc
+            || pp_info_socket.address_family != ADDR_FAMILY_UNIX
+            || pp_info_socket.transport_protocol != TRANSPORT_PROTOCOL_STREAM
+            || pp_info_socket.src_addr[0] || pp_info_socket.dst_addr[0]
+            || pp_info_from_socket(-1, &pp_info_socket))
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+#endif
+
+    /* Test pp_tlv_iter_t */
+    printf("Running test: pp_tlv_iter_init(), pp_tlv_iter_init_ssl(), pp_tlv_iter_next()...");
+    {
+        uint8_t pp2_hdr_vendor[] = {
+            0x0d, 0x0a, 0x0d, 0x0a, 0x00, 0x0d, 0x0a, 0x51, 0x55, 0x49, 0x54, 0x0a,
+            0x21, 0x11, 0x00, 0x16, /* ver_cmd, fam and len */
+            0xc0, 0xa8, 0x0a, 0x64, 0xc0, 0xa8, 0x0b, 0x5a, 0xa5, 0x5c, 0x1f, 0x90,
+            0xe0, 0x00, 0x03, 0x61, 0x62, 0x63, /* GCP like vendor TLV */
+            0x04, 0x00, 0x01, 0x00              /* NOOP TLV */
+        };
+        const uint8_t expected_types[] = { PP2_TYPE_SSL, PP2_TYPE_NOOP };
+        const uint8_t expected_ssl_types[] = {
+            PP2_SUBTYPE_SSL_VERSION, PP2_SUBTYPE_SSL_CN, PP2_SUBTYPE_SSL_CIPHER, PP2_SUBTYPE_SSL_SIG_ALG, PP2_SUBTYPE_SSL_KEY_ALG
+        };
+        pp_tlv_iter_t iter, sub_iter;
+        uint32_t count = 0, sub_count = 0;
+        uint8_t failed = pp_tlv_iter_init(&iter, pp2_hdr_ssl, sizeof(pp2_hdr_ssl)) != sizeof(pp2_hdr_ssl);
+        while (!failed && pp_tlv_iter_next(&iter))
+        {
+            failed = count >= NUM_ELEMS(expected_types) || iter.type != expected_types[count++];
+            if (!failed && iter.type == PP2_TYPE_SSL)
+            {
+                failed = pp_tlv_iter_init_ssl(&sub_iter, &iter) != ERR_NULL;
+                while (!failed && pp_tlv_iter_next(&sub_iter))
+                {
+                    failed = sub_count >= NUM_ELEMS(expected_ssl_types) || sub_iter.type != expected_ssl_types[sub_count++];
+                }
+                failed = failed || sub_iter.error != ERR_NULL;
+            }
+        }
+        failed = failed || iter.error != ERR_NULL || count != NUM_ELEMS(expected_types) || sub_count != NUM_ELEMS(expected_ssl_types);
+
+        /* Unknown types are yielded too */
+        count = 0;
+        failed = failed || pp_tlv_iter_init(&iter, pp2_hdr_vendor, sizeof(pp2_hdr_vendor)) != sizeof(pp2_hdr_vendor)
+                        || !pp_tlv_iter_next(&iter) || iter.type != 0xe0 || iter.length != 3 || memcmp(iter.value, "abc", 3)
+                        || iter.tlv != pp2_hdr_vendor + 28
+                        || !pp_tlv_iter_next(&iter) || iter.type != PP2_TYPE_NOOP || pp_tlv_iter_next(&iter) || iter.error != ERR_NULL;
+
+        /* A TLV overflowing the header */
+        pp2_hdr_vendor[30] = 0x08;
+        failed = failed || pp_tlv_iter_init(&iter, pp2_hdr_vendor, sizeof(pp2_hdr_vendor)) != sizeof(pp2_hdr_vendor)
+                        || pp_tlv_iter_next(&iter) || iter.error != -ERR_PP2_TLV_LENGTH
+                        || pp_tlv_iter_init(&iter, pp2_hdr_vendor, sizeof(pp2_hdr_vendor) - 1) != -ERR_PP2_LENGTH
+                        || pp_tlv_iter_next(&iter);
+
+        /* Every path frames the TLVs alike: bytes too few for a TLV header after the last TLV are ignored */
+        uint8_t pp2_hdr_trailing[sizeof(pp2_hdr_ssl) + 2] = { 0 };
+        uint8_t pp2_hdr_forwarded[sizeof(pp2_hdr_trailing) + 7];
+        memcpy(pp2_hdr_trailing, pp2_hdr_ssl, sizeof(pp2_hdr_ssl));
+        pp2_hdr_trailing[15] += 2;
+        pp_parse_cb_t no_cb;
+        memset(&no_cb, 0, sizeof(no_cb));
+        pp_info_t pp_info;
+        uint32_t tlvs = 0;
+        failed = failed || pp_tlv_iter_init(&iter, pp2_hdr_trailing, sizeof(pp2_hdr_trailing)) != sizeof(pp2_hdr_trailing);
+        while (!failed && pp_tlv_iter_next(&iter))
+        {
+            tlvs++;
+        }
+        failed = failed || iter.error != ERR_NULL || tlvs != 2
+                        || pp_parse_hdr(pp2_hdr_trailing, sizeof(pp2_hdr_trailing), &pp_info) != sizeof(pp2_hdr_trailing)
+                        || pp_parse_hdr_cb(pp2_hdr_trailing, sizeof(pp2_hdr_trailing), &no_cb, NULL) != sizeof(pp2_hdr_trailing)
+                        || pp2_verify_crc32c(pp2_hdr_trailing, sizeof(pp2_hdr_trailing)) != 0
+                        || pp2_forward_hdr(pp2_hdr_trailing, sizeof(pp2_hdr_trailing), NULL, NULL, 0, PP2_FORWARD_F_NONE,
+                                           pp2_hdr_forwarded, sizeof(pp2_hdr_forwarded)) != sizeof(pp2_hdr_ssl);
+        pp_info_clear(&pp_info);
+        if (failed)
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+
+    /* Test pp2_forward_hdr() */
+    printf("Running test: pp2_forward_hdr()...");
+    {
+        uint8_t pp2_hdr_vendor[64] = {
+            0x0d, 0x0a, 0x0d, 0x0a, 0x00, 0x0d, 0x0a, 0x51, 0x55, 0x49, 0x54, 0x0a,
+            0x21, 0x11, 0x00, 0x16, /* ver_cmd, fam and len */
+            0xc0, 0xa8, 0x0a, 0x64, 0xc0, 0xa8, 0x0b, 0x5a, 0xa5, 0x5c, 0x1f, 0x90,
+            0xe0, 0x00, 0x03, 0x61, 0x62, 0x63, /* GCP like vendor TLV */
+            0x04, 0x00, 0x01, 0x00              /* NOOP TLV */
+        };
+        const uint8_t expected[] = {
+            0x0d, 0x0a, 0x0d, 0x0a, 0x00, 0x0d, 0x0a, 0x51, 0x55, 0x49, 0x54, 0x0a,
+            0x21, 0x11, 0x00, 0x17, /* ver_cmd, fam and len */
+            0xc0, 0xa8, 0x0a, 0x64, 0xc0, 0xa8, 0x0b, 0x5a, 0xa5, 0x5c, 0x1f, 0x90,
+            0xe0, 0x00, 0x03, 0x61, 0x62, 0x63, /* GCP like vendor TLV */
+            0x05, 0x00, 0x02, 0x69, 0x64        /* Unique ID TLV */
+        };
+        uint8_t strip_types[PP_TLV_TYPE_MASK_SIZE] = { 0 };
+        uint8_t append_tlvs[8];
+        uint8_t out[64];
+        uint16_t append_tlvs_len = pp2_tlv_write(append_tlvs, sizeof(append_tlvs), PP2_TYPE_UNIQUE_ID, 2, (const uint8_t*) "id");
+        PP_TLV_TYPE_MASK_SET(strip_types, PP2_TYPE_NOOP);
+
+        uint8_t failed = append_tlvs_len != 5 || pp2_tlv_write(append_tlvs, 4, PP2_TYPE_UNIQUE_ID, 2, (const uint8_t*) "id") != 0
+                      || pp2_forward_hdr(pp2_hdr_vendor, 38, strip_types, append_tlvs, append_tlvs_len, PP2_FORWARD_F_NONE, out, sizeof(out)) != sizeof(expected)
+                      || memcmp(out, expected, sizeof(expected))
+                      || pp2_forward_hdr(pp2_hdr_vendor, 38, strip_types, append_tlvs, append_tlvs_len, PP2_FORWARD_F_NONE, out, sizeof(expected) - 1) != -ERR_PP2_LENGTH
+                      || pp2_forward_hdr(pp2_hdr_vendor, 37, NULL, NULL, 0, PP2_FORWARD_F_NONE, out, sizeof(out)) != -ERR_PP2_LENGTH
+                      || pp2_forward_hdr(pp2_hdr_vendor, 38, NULL, append_tlvs, append_tlvs_len - 1, PP2_FORWARD_F_NONE, out, sizeof(out)) != -ERR_PP2_TLV_LENGTH;
+
+        /* In place, stripping the vendor TLV and adding a CRC32c the parser verifies */
+        PP_TLV_TYPE_MASK_SET(strip_types, 0xe0);
+        int32_t len = pp2_forward_hdr(pp2_hdr_vendor, 38, strip_types, append_tlvs, append_tlvs_len, PP2_FORWARD_F_CRC32C, pp2_hdr_vendor, sizeof(pp2_hdr_vendor));
+        pp_info_t pp_info;
+        uint16_t unique_id_len = 0;
+        const uint8_t *unique_id = NULL;
+        failed = failed || len != 28 + 5 + 7 || pp_parse_hdr(pp2_hdr_vendor, len, &pp_info) != len;
+        if (!failed)
+        {
+            unique_id = pp_info_get_unique_id(&pp_info, &unique_id_len);
+            failed = !unique_id || unique_id_len != 2 || memcmp(unique_id, "id", 2) || !pp_info.pp2_info.crc32c
+                  || pp_info.src_port != 42332 || strcmp(pp_info.src_addr, "192.168.10.100");
+        }
+        pp_info_clear(&pp_info);
+
+        /* A received checksum is verified before it is replaced, in place too, unless the upstream is trusted */
+        uint8_t pp2_hdr[sizeof(pp2_hdr_vpce)];
+        uint8_t pp2_hdr_out[sizeof(pp2_hdr_vpce)];
+        memcpy(pp2_hdr, pp2_hdr_vpce, sizeof(pp2_hdr));
+        pp2_hdr[sizeof(pp2_hdr) - 1] ^= 0x80;
+        failed = failed || pp2_forward_hdr(pp2_hdr_vpce, sizeof(pp2_hdr_vpce), NULL, NULL, 0, PP2_FORWARD_F_CRC32C, pp2_hdr_out, sizeof(pp2_hdr_out)) != sizeof(pp2_hdr_vpce)
+                        || pp2_forward_hdr(pp2_hdr, sizeof(pp2_hdr), NULL, NULL, 0, PP2_FORWARD_F_CRC32C, pp2_hdr_out, sizeof(pp2_hdr_out)) != -ERR_PP2_TYPE_CRC32C
+                        || pp2_forward_hdr(pp2_hdr, sizeof(pp2_hdr), NULL, NULL, 0, PP2_FORWARD_F_NONE, pp2_hdr, sizeof(pp2_hdr)) != -ERR_PP2_TYPE_CRC32C
+                        || pp2_hdr[sizeof(pp2_hdr) - 1] != (pp2_hdr_vpce[sizeof(pp2_hdr) - 1] ^ 0x80)
+                        || pp2_forward_hdr(pp2_hdr, sizeof(pp2_hdr), NULL, NULL, 0, PP2_FORWARD_F_CRC32C | PP2_FORWARD_F_CRC32C_SKIP,
+                                           pp2_hdr_out, sizeof(pp2_hdr_out)) != sizeof(pp2_hdr)
+                        || pp2_verify_crc32c(pp2_hdr_out, sizeof(pp2_hdr_out)) != sizeof(pp2_hdr_out);
+        if (failed)
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+
+    /* Test pp_transcode() */
+    printf("Running test: pp_transcode()...");
+    {
+        const char *pp1_hdrs[] = {
+            "PROXY TCP4 192.168.10.100 192.168.11.90 42332 8080\r\n",
+            "PROXY TCP6 2001:db8::1 ::ffff:192.168.11.90 1 65535\r\n",
+        };
+        pp_builder_t builder, builder_back;
+        pp_builder_init(&builder);
+        pp_builder_init(&builder_back);
+        const uint8_t *pp_hdr = NULL, *pp_hdr_back = NULL;
+        uint16_t pp_hdr_len = 0, pp_hdr_back_len = 0;
+        uint8_t failed = 0;
+        for (i = 0; !failed && i < NUM_ELEMS(pp1_hdrs); i++)
+        {
+            /* v1 => v2 equals what the creation makes of the same addresses and v2 => v1 gives back the line */
+            int32_t pp1_hdr_len = strlen(pp1_hdrs[i]);
+            uint16_t pp2_hdr_len = 0;
+            int32_t error;
+            failed = pp_transcode(&builder, (const uint8_t*) pp1_hdrs[i], pp1_hdr_len, &pp_hdr, &pp_hdr_len) != pp1_hdr_len;
+            uint8_t *pp2_hdr = failed ? NULL : pp_create_hdr(2, &builder.pp_info, &pp2_hdr_len, &error);
+            failed = failed || !pp2_hdr || pp2_hdr_len != pp_hdr_len || memcmp(pp2_hdr, pp_hdr, pp_hdr_len)
+                            || pp_transcode(&builder_back, pp_hdr, pp_hdr_len, &pp_hdr_back, &pp_hdr_back_len) != pp_hdr_len
+                            || pp_hdr_back_len != pp1_hdr_len || memcmp(pp_hdr_back, pp1_hdrs[i], pp1_hdr_len);
+            free(pp2_hdr);
+        }
+
+        /* UNKNOWN <=> LOCAL */
+        const char pp1_hdr_unknown[] = "PROXY UNKNOWN\r\n";
+        uint16_t healthcheck_hdr_len;
+        const uint8_t *healthcheck_hdr = pp2_get_healthcheck_hdr(0, &healthcheck_hdr_len);
+        failed = failed || pp_transcode(&builder, (const uint8_t*) pp1_hdr_unknown, strlen(pp1_hdr_unknown), &pp_hdr, &pp_hdr_len) != 15
+                        || pp_hdr_len != healthcheck_hdr_len || memcmp(pp_hdr, healthcheck_hdr, healthcheck_hdr_len)
+                        || pp_transcode(&builder_back, healthcheck_hdr, healthcheck_hdr_len, &pp_hdr_back, &pp_hdr_back_len) != healthcheck_hdr_len
+                        || pp_hdr_back_len != 15 || memcmp(pp_hdr_back, pp1_hdr_unknown, 15);
+
+        /* AF_UNSPEC and AF_UNIX have no v1 form: UNKNOWN */
+        uint8_t pp2_hdr[16 + 216] = { 0 };
+        memcpy(pp2_hdr, healthcheck_hdr, healthcheck_hdr_len);
+        pp2_hdr[12] = 0x21;
+        failed = failed || pp_transcode(&builder_back, pp2_hdr, 16, &pp_hdr_back, &pp_hdr_back_len) != 16
+                        || pp_hdr_back_len != 15 || memcmp(pp_hdr_back, pp1_hdr_unknown, 15);
+        pp2_hdr[13] = (ADDR_FAMILY_UNIX << 4) | TRANSPORT_PROTOCOL_STREAM;
+        pp2_hdr[15] = 216;
+        failed = failed || pp_transcode(&builder_back, pp2_hdr, sizeof(pp2_hdr), &pp_hdr_back, &pp_hdr_back_len) != sizeof(pp2_hdr)
+                        || pp_hdr_back_len != 15 || memcmp(pp_hdr_back, pp1_hdr_unknown, 15);
+
+        /* An invalid command or transport protocol is an error, not UNKNOWN */
+        pp2_hdr[12] = 0x22;
+        failed = failed || pp_transcode(&builder_back, pp2_hdr, sizeof(pp2_hdr), &pp_hdr_back, &pp_hdr_back_len) != -ERR_PP2_CMD;
+        pp2_hdr[12] = 0x21;
+        pp2_hdr[13] = (ADDR_FAMILY_UNIX << 4) | (TRANSPORT_PROTOCOL_DGRAM + 1);
+        failed = failed || pp_transcode(&builder_back, pp2_hdr, sizeof(pp2_hdr), &pp_hdr_back, &pp_hdr_back_len) != -ERR_PP2_TRANSPORT_PROTOCOL;
+
+        /* Errors */
+        const char pp1_hdr_invalid[] = "PROXY TCP4 192.168.10.256 192.168.11.90 42332 8080\r\n";
+        failed = failed || pp_transcode(&builder, (const uint8_t*) pp1_hdr_invalid, strlen(pp1_hdr_invalid), &pp_hdr, &pp_hdr_len) != -ERR_PP1_IPV4_SRC_IP
+                        || pp_hdr || pp_transcode(&builder, (const uint8_t*) "GET / HTTP/1.1\r\n", 16, &pp_hdr, &pp_hdr_len) != 0
+                        || pp_transcode(&builder_back, healthcheck_hdr, healthcheck_hdr_len - 1, &pp_hdr_back, &pp_hdr_back_len) != 0;
+
+        pp_builder_free(&builder);
+        pp_builder_free(&builder_back);
+        if (failed)
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+
+    /* Test pp_ctx_t */
+    printf("Running test: pp_parse_hdr_ctx(), pp_create_hdr_ctx()...");
+    {
+        pp_ctx_t ctx;
+        pp_ctx_init(&ctx);
+        ctx.realloc_fn = test_realloc;
+        ctx.free_fn = test_free;
+
+        /* Allocator hooks */
+        pp_info_t pp_info;
+        uint8_t failed = pp_parse_hdr_ctx(&ctx, pp2_hdr_ssl, sizeof(pp2_hdr_ssl), &pp_info) != sizeof(pp2_hdr_ssl)
+                      || !test_realloc_calls || test_realloc_calls != ctx.stats.allocations;
+        pp_info_clear(&pp_info);
+        failed = failed || test_free_calls != test_realloc_calls;
+
+        uint16_t pp_hdr_len = 0;
+        int32_t error;
+        pp_info_t pp_info_in = {
+            .address_family = ADDR_FAMILY_INET,
+            .transport_protocol = TRANSPORT_PROTOCOL_STREAM,
+            .src_addr = "192.168.10.100",
+            .dst_addr = "192.168.11.90",
+            .src_port = 42332,
+            .dst_port = 8080
+        };
+        uint8_t *pp_hdr = pp_create_hdr_ctx(&ctx, 1, &pp_info_in, &pp_hdr_len, &error);
+        failed = failed || !pp_hdr || pp_create_hdr_ctx(&ctx, 3, &pp_info_in, &pp_hdr_len, &error) || error != -ERR_PP_VERSION
+                        || pp_parse_hdr_ctx(&ctx, (uint8_t*) "PROXY TCP4\r\n", 12, &pp_info) >= 0;
+        pp_ctx_free(&ctx, pp_hdr);
+        failed = failed || test_free_calls != test_realloc_calls || ctx.stats.parsed != 1 || ctx.stats.parsed_bytes != sizeof(pp2_hdr_ssl)
+                        || ctx.stats.parse_errors != 1 || ctx.stats.created != 1 || ctx.stats.create_errors != 1;
+
+        /* Arena: nothing goes through the hooks and exhausting it is an allocation failure */
+        uint64_t arena[128];
+        uint32_t realloc_calls = test_realloc_calls;
+        pp_ctx_set_arena(&ctx, arena, sizeof(arena));
+        failed = failed || pp_parse_hdr_ctx(&ctx, pp2_hdr_ssl, sizeof(pp2_hdr_ssl), &pp_info) != sizeof(pp2_hdr_ssl)
+                        || !pp_info_get_ssl_cn(&pp_info, &pp_hdr_len) || pp_hdr_len != 11;
+        pp_info_clear(&pp_info);
+        pp_hdr = pp_create_hdr_ctx(&ctx, 2, &pp_info_in, &pp_hdr_len, &error);
+        failed = failed || !pp_hdr || (uint8_t*) pp_hdr < (uint8_t*) arena || (uint8_t*) pp_hdr >= (uint8_t*) arena + sizeof(arena)
+                        || test_realloc_calls != realloc_calls;
+        pp_ctx_free(&ctx, pp_hdr);
+        pp_ctx_set_arena(&ctx, arena, 64);
+        failed = failed || pp_parse_hdr_ctx(&ctx, pp2_hdr_ssl, sizeof(pp2_hdr_ssl), &pp_info) != -ERR_PP_CAPACITY;
+        pp_info_clear(&pp_info);
+        pp_ctx_reset_arena(&ctx);
+        failed = failed || ctx.arena_used != 0 || test_free_calls != test_realloc_calls;
+        if (failed)
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+
+    /* Test the zero allocation mode */
+    printf("Running test: PP_CTX_F_NO_HEAP...");
+    {
+        pp_ctx_t ctx;
+        pp_ctx_init(&ctx);
+        ctx.realloc_fn = test_realloc;
+        ctx.free_fn = test_free;
+        ctx.flags = PP_CTX_F_NO_HEAP;
+        uint32_t realloc_calls = test_realloc_calls;
+        uint32_t free_calls = test_free_calls;
+
+        /* Parsing and creating back over and over never reaches the allocator */
+        pp_info_t pp_info;
+        uint16_t pp_hdr_len = 0;
+        int32_t error;
+        uint8_t failed = 0;
+        for (i = 0; !failed && i < 100; i++)
+        {
+            failed = pp_parse_hdr_ctx(&ctx, pp2_hdr_ssl, sizeof(pp2_hdr_ssl), &pp_info) != sizeof(pp2_hdr_ssl)
+                  || !pp_info_get_ssl_cipher(&pp_info, &pp_hdr_len)
+                  || !pp_create_hdr_ctx(&ctx, 1, &pp_info, &pp_hdr_len, &error);
+            pp_info_clear(&pp_info);
+        }
+        failed = failed || test_realloc_calls != realloc_calls || test_free_calls != free_calls || !ctx.stats.allocations;
+
+        /* A TLV bigger than the inline storage */
+        uint8_t authority[PP_CTX_INLINE_STORAGE_SIZE + 1] = { 0 };
+        pp_info_t pp_info_in = { .address_family = ADDR_FAMILY_UNSPEC, .pp2_info = { .local = 1 } };
+        uint8_t *pp_hdr = NULL;
+        failed = failed || !pp_info_add_authority(&pp_info_in, sizeof(authority), authority)
+                        || !(pp_hdr = pp_create_hdr(2, &pp_info_in, &pp_hdr_len, &error))
+                        || pp_parse_hdr_ctx(&ctx, pp_hdr, pp_hdr_len, &pp_info) != -ERR_PP_CAPACITY
+                        || pp_create_hdr_ctx(&ctx, 2, &pp_info_in, &pp_hdr_len, &error) || error != -ERR_PP_CAPACITY
+                        || test_realloc_calls != realloc_calls || test_free_calls != free_calls;
+        pp_info_clear(&pp_info);
+        pp_info_clear(&pp_info_in);
+        free(pp_hdr);
+
+        /* Clearing a pp_info_t whose TLVs a later parsing invalidated leaves the latest one intact */
+        pp_info_t pp_info_stale;
+        failed = failed || pp_parse_hdr_ctx(&ctx, pp2_hdr_ssl, sizeof(pp2_hdr_ssl), &pp_info_stale) != sizeof(pp2_hdr_ssl)
+                        || pp_parse_hdr_ctx(&ctx, pp2_hdr_ssl, sizeof(pp2_hdr_ssl), &pp_info) != sizeof(pp2_hdr_ssl);
+        pp_info_clear(&pp_info_stale);
+        failed = failed || !pp_info_get_ssl_cipher(&pp_info, &pp_hdr_len) || pp_hdr_len != 28;
+        pp_info_clear(&pp_info);
+
+        /* The storage is released the way it was allocated even when the flags or the arena changed in between */
+        failed = failed || pp_parse_hdr_ctx(&ctx, pp2_hdr_ssl, sizeof(pp2_hdr_ssl), &pp_info) != sizeof(pp2_hdr_ssl);
+        ctx.flags = PP_CTX_F_NONE;
+        pp_info_clear(&pp_info);
+        failed = failed || test_realloc_calls != realloc_calls || test_free_calls != free_calls;
+        uint64_t arena[64];
+        pp_ctx_set_arena(&ctx, arena, sizeof(arena));
+        failed = failed || pp_parse_hdr_ctx(&ctx, pp2_hdr_ssl, sizeof(pp2_hdr_ssl), &pp_info) != sizeof(pp2_hdr_ssl);
+        pp_ctx_set_arena(&ctx, NULL, 0);
+        pp_info_clear(&pp_info);
+        failed = failed || test_realloc_calls != realloc_calls || test_free_calls != free_calls;
+        failed = failed || pp_parse_hdr_ctx(&ctx, pp2_hdr_ssl, sizeof(pp2_hdr_ssl), &pp_info) != sizeof(pp2_hdr_ssl);
+        ctx.flags = PP_CTX_F_NO_HEAP;
+        pp_info_clear(&pp_info);
+        failed = failed || test_realloc_calls - realloc_calls != test_free_calls - free_calls;
+        if (failed)
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+
+    /* Test the deferred CRC32c verification */
+    printf("Running test: PP_CTX_F_CRC32C_DEFERRED, PP_CTX_F_CRC32C_SKIP, pp_info_verify_crc32c(), pp2_verify_crc32c()...");
+    {
+        pp_ctx_t ctx;
+        pp_ctx_init(&ctx);
+        ctx.flags = PP_CTX_F_CRC32C_DEFERRED;
+        uint8_t pp2_hdr_corrupted[sizeof(pp2_hdr_vpce)];
+        memcpy(pp2_hdr_corrupted, pp2_hdr_vpce, sizeof(pp2_hdr_vpce));
+        pp2_hdr_corrupted[16] ^= 0x01; /* First source address byte */
+
+        pp_info_t pp_info;
+        uint8_t failed = pp_parse_hdr_ctx(&ctx, pp2_hdr_vpce, sizeof(pp2_hdr_vpce), &pp_info) != sizeof(pp2_hdr_vpce)
+                      || pp_info.pp2_info.crc32c != 2
+                      || pp_info_verify_crc32c(&pp_info, pp2_hdr_vpce, sizeof(pp2_hdr_vpce)) != ERR_NULL
+                      || pp_info.pp2_info.crc32c != 1
+                      || pp_info_verify_crc32c(&pp_info, pp2_hdr_vpce, sizeof(pp2_hdr_vpce)) != ERR_NULL;
+        pp_info_clear(&pp_info);
+        failed = failed || pp_parse_hdr_ctx(&ctx, pp2_hdr_corrupted, sizeof(pp2_hdr_corrupted), &pp_info) != sizeof(pp2_hdr_corrupted)
+                        || pp_info.pp2_info.crc32c != 2
+                        || pp_info_verify_crc32c(&pp_info, pp2_hdr_corrupted, sizeof(pp2_hdr_corrupted)) != -ERR_PP2_TYPE_CRC32C
+                        || pp_info_verify_crc32c(&pp_info, pp2_hdr_corrupted, 16) != -ERR_PP2_LENGTH
+                        || pp_info.pp2_info.crc32c != 2;
+        pp_info_clear(&pp_info);
+        failed = failed || pp_parse_hdr(pp2_hdr_corrupted, sizeof(pp2_hdr_corrupted), &pp_info) != -ERR_PP2_TYPE_CRC32C;
+        pp_info_clear(&pp_info);
+
+        /* Framing only verification */
+        failed = failed || pp2_verify_crc32c(pp2_hdr_vpce, sizeof(pp2_hdr_vpce)) != sizeof(pp2_hdr_vpce)
+                        || pp2_verify_crc32c(pp2_hdr_corrupted, sizeof(pp2_hdr_corrupted)) != -ERR_PP2_TYPE_CRC32C
+                        || pp2_verify_crc32c(pp2_hdr_ssl, sizeof(pp2_hdr_ssl)) != 0
+                        || pp2_verify_crc32c(pp2_hdr_vpce, sizeof(pp2_hdr_vpce) - 1) != -ERR_PP2_LENGTH;
+
+        /* Trusted upstream: the value is exposed as received */
+        uint16_t crc32c_len = 0;
+        const uint8_t *crc32c = NULL;
+        ctx.flags = PP_CTX_F_CRC32C_SKIP;
+        failed = failed || pp_parse_hdr_ctx(&ctx, pp2_hdr_corrupted, sizeof(pp2_hdr_corrupted), &pp_info) != sizeof(pp2_hdr_corrupted)
+                        || pp_info.pp2_info.crc32c != 3 || !(crc32c = pp_info_get_crc32c(&pp_info, &crc32c_len)) || crc32c_len != 4
+                        || memcmp(crc32c, "\xf8\x86\x18\xe5", 4)
+                        || pp_info_verify_crc32c(&pp_info, pp2_hdr_corrupted, sizeof(pp2_hdr_corrupted)) != -ERR_PP2_TYPE_CRC32C;
+        pp_info_clear(&pp_info);
+
+        /* A garbage checksum followed by a valid one covering it */
+        uint8_t tlv_crc32c[3 + 4];
+        uint8_t pp2_hdr_crc32c_twice[sizeof(pp2_hdr_vpce) + sizeof(tlv_crc32c)];
+        pp2_tlv_write(tlv_crc32c, sizeof(tlv_crc32c), PP2_TYPE_CRC32C, 4, (const uint8_t*) "\xde\xad\xbe\xef");
+        int32_t pp2_hdr_len = pp2_forward_hdr(pp2_hdr_vpce, sizeof(pp2_hdr_vpce), NULL, tlv_crc32c, sizeof(tlv_crc32c), PP2_FORWARD_F_CRC32C,
+                                              pp2_hdr_crc32c_twice, sizeof(pp2_hdr_crc32c_twice));
+        pp_parse_cb_t no_cb;
+        memset(&no_cb, 0, sizeof(no_cb));
+        failed = failed || pp2_hdr_len != sizeof(pp2_hdr_crc32c_twice)
+                        || pp_parse_hdr(pp2_hdr_crc32c_twice, pp2_hdr_len, &pp_info) != -ERR_PP2_TYPE_CRC32C
+                        || pp2_verify_crc32c(pp2_hdr_crc32c_twice, pp2_hdr_len) != -ERR_PP2_TYPE_CRC32C
+                        || pp_parse_hdr_cb(pp2_hdr_crc32c_twice, pp2_hdr_len, &no_cb, NULL) != -ERR_PP2_TYPE_CRC32C;
+        pp_info_clear(&pp_info);
+        if (failed)
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+
+    /* Test the batch functions against their single header counterparts. More elements than one CRC32c batch holds */
+    printf("Running test: pp2_verify_crc32c_batch(), pp_parse_hdr_batch(), pp2_create_hdr_batch()...");
+    {
+        pp_ctx_t ctx;
+        pp_ctx_init(&ctx);
+        uint8_t pp2_hdr_corrupted[sizeof(pp2_hdr_vpce)];
+        memcpy(pp2_hdr_corrupted, pp2_hdr_vpce, sizeof(pp2_hdr_vpce));
+        pp2_hdr_corrupted[sizeof(pp2_hdr_vpce) - 1] ^= 0x80;
+
+        uint8_t *hdrs[67];
+        uint32_t lens[NUM_ELEMS(hdrs)];
+        int32_t results[NUM_ELEMS(hdrs)];
+        pp_info_t pp_infos[NUM_ELEMS(hdrs)];
+        uint8_t failed = 0;
+        uint32_t expected_verified = 0;
+        uint32_t expected_parsed = 0;
+        for (i = 0; i < NUM_ELEMS(hdrs); i++)
+        {
+            hdrs[i] = i % 5 == 3 ? pp2_hdr_corrupted : i % 5 == 4 ? pp2_hdr_ssl : pp2_hdr_vpce;
+            lens[i] = i % 5 == 4 ? sizeof(pp2_hdr_ssl) : i == 1 ? 20 : sizeof(pp2_hdr_vpce);
+            expected_verified += pp2_verify_crc32c(hdrs[i], lens[i]) > 0;
+            expected_parsed += pp_parse_hdr(hdrs[i], lens[i], &pp_infos[i]) > 0;
+            pp_info_clear(&pp_infos[i]);
+        }
+        failed = pp2_verify_crc32c_batch((const uint8_t *const*) hdrs, lens, NUM_ELEMS(hdrs), results) != expected_verified;
+        for (i = 0; i < NUM_ELEMS(hdrs) && !failed; i++)
+        {
+            failed = results[i] != pp2_verify_crc32c(hdrs[i], lens[i]);
+        }
+        failed = failed || pp_parse_hdr_batch(&ctx, hdrs, lens, NUM_ELEMS(hdrs), pp_infos, results) != expected_parsed
+                        || ctx.stats.parsed != expected_parsed || ctx.stats.parse_errors != NUM_ELEMS(hdrs) - expected_parsed;
+        for (i = 0; i < NUM_ELEMS(hdrs); i++)
+        {
+            pp_info_t pp_info;
+            failed = failed || results[i] != pp_parse_hdr(hdrs[i], lens[i], &pp_info)
+                            || (results[i] > 0 && (pp_infos[i].pp2_info.crc32c != pp_info.pp2_info.crc32c || strcmp(pp_infos[i].src_addr, pp_info.src_addr)));
+            pp_info_clear(&pp_info);
+            pp_info_clear(&pp_infos[i]);
+        }
+
+        /* Every element differs and every fifth one has no checksum */
+        uint16_t hdr_lens[NUM_ELEMS(hdrs)];
+        for (i = 0; i < NUM_ELEMS(hdrs); i++)
+        {
+            memset(&pp_infos[i], 0, sizeof(pp_info_t));
+            pp_infos[i].address_family = ADDR_FAMILY_INET;
+            pp_infos[i].transport_protocol = TRANSPORT_PROTOCOL_STREAM;
+            sprintf(pp_infos[i].src_addr, "10.0.0.%u", i);
+            strcpy(pp_infos[i].dst_addr, "10.0.1.1");
+            pp_infos[i].src_port = 1024 + i;
+            pp_infos[i].dst_port = 443;
+            pp_infos[i].pp2_info.crc32c = i % 5 != 0;
+            pp_infos[i].pp2_info.alignment_power = i % 3 ? 0 : 5;
+        }
+        pp_infos[2].transport_protocol = 0xff;
+        failed = failed || pp2_create_hdr_batch(&ctx, pp_infos, NUM_ELEMS(hdrs), hdrs, hdr_lens, results) != NUM_ELEMS(hdrs) - 1
+                        || hdrs[2] || results[2] != -ERR_PP2_TRANSPORT_PROTOCOL || ctx.stats.created != NUM_ELEMS(hdrs) - 1;
+        for (i = 0; i < NUM_ELEMS(hdrs); i++)
+        {
+            uint16_t pp_hdr_len;
+            int32_t error;
+            uint8_t *pp_hdr = pp_create_hdr(2, &pp_infos[i], &pp_hdr_len, &error);
+            failed = failed || error != results[i] || (pp_hdr && (hdr_lens[i] != pp_hdr_len || memcmp(hdrs[i], pp_hdr, pp_hdr_len)));
+            free(pp_hdr);
+            pp_ctx_free(&ctx, hdrs[i]);
+        }
+        if (failed)
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+
+    /* Test the CRC32c engines against each other: every length up to a few KB, then up to the largest header */
+    printf("Running test: PP_CRC32C_ENGINE_AUTO against PP_CRC32C_ENGINE_TABLE, pp_info_verify_crc32c(), pp_parse_hdr_batch()...");
+    {
+        static uint8_t value[UINT16_MAX];
+        static uint8_t tlvs[UINT16_MAX];
+        static uint8_t pp2_hdr[UINT16_MAX];
+        pp_ctx_t ctx;
+        pp_ctx_init(&ctx);
+        ctx.crc32c_engine = PP_CRC32C_ENGINE_TABLE;
+        uint16_t healthcheck_hdr_len;
+        const uint8_t *healthcheck_hdr = pp2_get_healthcheck_hdr(0, &healthcheck_hdr_len);
+        for (i = 0; i < sizeof(value); i++)
+        {
+            value[i] = i * 131 + (i >> 8);
+        }
+
+        uint8_t failed = 0;
+        uint32_t length;
+        for (length = 0; length <= UINT16_MAX - 16 - 3 - 7 && !failed; length += length < 4096 ? 1 : 1021)
+        {
+            /* Created with the automatic engine, parsed, verified later and batch parsed with the table */
+            uint16_t tlvs_len = pp2_tlv_write(tlvs, sizeof(tlvs), PP2_TYPE_NOOP, length, value);
+            int32_t pp2_hdr_len = pp2_forward_hdr(healthcheck_hdr, healthcheck_hdr_len, NULL, tlvs, tlvs_len, PP2_FORWARD_F_CRC32C, pp2_hdr, sizeof(pp2_hdr));
+            uint8_t *buffers[] = { pp2_hdr };
+            uint32_t buffer_length = pp2_hdr_len;
+            int32_t result;
+            pp_info_t pp_info;
+            failed = pp2_hdr_len <= 0 || pp_parse_hdr_ctx(&ctx, pp2_hdr, pp2_hdr_len, &pp_info) != pp2_hdr_len || pp_info.pp2_info.crc32c != 1
+                                      || pp2_verify_crc32c(pp2_hdr, pp2_hdr_len) != pp2_hdr_len;
+            pp_info_clear(&pp_info);
+            ctx.flags = PP_CTX_F_CRC32C_DEFERRED;
+            failed = failed || pp_parse_hdr_ctx(&ctx, pp2_hdr, pp2_hdr_len, &pp_info) != pp2_hdr_len
+                            || pp_info_verify_crc32c(&pp_info, pp2_hdr, pp2_hdr_len) != ERR_NULL || pp_info.pp2_info.crc32c != 1;
+            pp_info_clear(&pp_info);
+            ctx.flags = PP_CTX_F_NONE;
+            failed = failed || pp_parse_hdr_batch(&ctx, buffers, &buffer_length, 1, &pp_info, &result) != 1 || result != pp2_hdr_len;
+            pp_info_clear(&pp_info);
+            if (!failed && length)
+            {
+                pp2_hdr[16 + 3 + length / 2] ^= 0x10;
+                failed = pp_parse_hdr_ctx(&ctx, pp2_hdr, pp2_hdr_len, &pp_info) != -ERR_PP2_TYPE_CRC32C
+                      || pp2_verify_crc32c(pp2_hdr, pp2_hdr_len) != -ERR_PP2_TYPE_CRC32C;
+                pp_info_clear(&pp_info);
+                ctx.flags = PP_CTX_F_CRC32C_DEFERRED;
+                failed = failed || pp_parse_hdr_ctx(&ctx, pp2_hdr, pp2_hdr_len, &pp_info) != pp2_hdr_len
+                                || pp_info_verify_crc32c(&pp_info, pp2_hdr, pp2_hdr_len) != -ERR_PP2_TYPE_CRC32C;
+                pp_info_clear(&pp_info);
+                ctx.flags = PP_CTX_F_NONE;
+                failed = failed || pp_parse_hdr_batch(&ctx, buffers, &buffer_length, 1, &pp_info, &result) != 0 || result != -ERR_PP2_TYPE_CRC32C;
+                pp_info_clear(&pp_info);
+            }
+        }
+        if (failed)
+        {
+            printf("FAILED at %u bytes\n", length);
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+
+    /* Test the widest folding path, from 8 KB, against the table. Which path the CPU has is shown, not skipped silently */
+#if defined(__GNUC__) && defined(__x86_64__)
+    __builtin_cpu_init();
+    printf("Running test: PP_CRC32C_ENGINE_AUTO against PP_CRC32C_ENGINE_TABLE from 8 KB (%s)...",
+           __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("vpclmulqdq") ? "VPCLMULQDQ"
+           : __builtin_cpu_supports("pclmul") ? "PCLMULQDQ" : "table only");
+#else
+    printf("Running test: PP_CRC32C_ENGINE_AUTO against PP_CRC32C_ENGINE_TABLE from 8 KB (table only)...");
+#endif
+    {
+        static uint8_t value[UINT16_MAX];
+        static uint8_t tlvs[UINT16_MAX];
+        static uint8_t pp2_hdr[UINT16_MAX];
+        pp_ctx_t ctx;
+        pp_ctx_init(&ctx);
+        ctx.crc32c_engine = PP_CRC32C_ENGINE_TABLE;
+        uint16_t healthcheck_hdr_len;
+        const uint8_t *healthcheck_hdr = pp2_get_healthcheck_hdr(0, &healthcheck_hdr_len);
+        for (i = 0; i < sizeof(value); i++)
+        {
+            value[i] = i * 197 + (i >> 9);
+        }
+
+        /* Every tail length around the threshold, then strides across the rest of the range */
+        uint8_t failed = 0;
+        uint32_t length;
+        for (length = 8192 - 64; length <= UINT16_MAX - 16 - 3 - 7 && !failed; length += length < 8192 + 512 ? 1 : 251)
+        {
+            uint16_t tlvs_len = pp2_tlv_write(tlvs, sizeof(tlvs), PP2_TYPE_NOOP, length, value);
+            int32_t pp2_hdr_len = pp2_forward_hdr(healthcheck_hdr, healthcheck_hdr_len, NULL, tlvs, tlvs_len, PP2_FORWARD_F_CRC32C, pp2_hdr, sizeof(pp2_hdr));
+            pp_info_t pp_info;
+            failed = pp2_hdr_len <= 0 || pp_parse_hdr_ctx(&ctx, pp2_hdr, pp2_hdr_len, &pp_info) != pp2_hdr_len;
+            pp_info_clear(&pp_info);
+            pp2_hdr[16 + 3 + (length * 7) / 8] ^= 0x01;
+            failed = failed || pp_parse_hdr_ctx(&ctx, pp2_hdr, pp2_hdr_len, &pp_info) != -ERR_PP2_TYPE_CRC32C
+                            || pp2_verify_crc32c(pp2_hdr, pp2_hdr_len) != -ERR_PP2_TYPE_CRC32C;
+            pp_info_clear(&pp_info);
+        }
+        if (failed)
+        {
+            printf("FAILED at %u bytes\n", length);
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+
+    /* Test the application TLV handlers */
+    printf("Running test: pp_register_tlv_handler()...");
+    {
+        test_tlv_decoded_t vendor, aws;
+        memset(&vendor, 0, sizeof(vendor));
+        memset(&aws, 0, sizeof(aws));
+        pp_tlv_handlers_t tlv_handlers;
+        memset(&tlv_handlers, 0, sizeof(tlv_handlers));
+        pp_register_tlv_handler(&tlv_handlers, 0xE0, test_tlv_handler, &vendor);
+        pp_register_tlv_handler(&tlv_handlers, PP2_TYPE_AWS, test_tlv_handler, &aws);
+        pp_ctx_t ctx;
+        pp_ctx_init(&ctx);
+        ctx.tlv_handlers = &tlv_handlers;
+
+        /* A vendor TLV the library does not know, appended to one with AWS */
+        uint8_t tlvs[16];
+        uint8_t pp2_hdr[sizeof(pp2_hdr_vpce) + sizeof(tlvs)];
+        uint16_t tlvs_len = pp2_tlv_write(tlvs, sizeof(tlvs), 0xE0, 6, (const uint8_t*) "vendor");
+        int32_t pp2_hdr_len = pp2_forward_hdr(pp2_hdr_vpce, sizeof(pp2_hdr_vpce), NULL, tlvs, tlvs_len, PP2_FORWARD_F_CRC32C, pp2_hdr, sizeof(pp2_hdr));
+        pp_info_t pp_info;
+        uint16_t length;
+        uint8_t failed = pp_parse_hdr_ctx(&ctx, pp2_hdr, pp2_hdr_len, &pp_info) != pp2_hdr_len
+                      || vendor.calls != 1 || vendor.type != 0xE0 || vendor.length != 6 || memcmp(vendor.value, "vendor", 6)
+                      || aws.calls != 1 || aws.type != PP2_TYPE_AWS || aws.value[0] != PP2_SUBTYPE_AWS_VPCE_ID
+                      || !pp_info_get_aws_vpce_id(&pp_info, &length);
+        pp_info_clear(&pp_info);
+
+        /* Without the context the handlers are not called */
+        failed = failed || pp_parse_hdr(pp2_hdr, pp2_hdr_len, &pp_info) != pp2_hdr_len || vendor.calls != 1;
+        pp_info_clear(&pp_info);
+
+        /* A handler's error aborts the parsing */
+        tlvs_len = pp2_tlv_write(tlvs, sizeof(tlvs), 0xE0, 0, (const uint8_t*) "");
+        pp2_hdr_len = pp2_forward_hdr(pp2_hdr_vpce, sizeof(pp2_hdr_vpce), NULL, tlvs, tlvs_len, PP2_FORWARD_F_NONE, pp2_hdr, sizeof(pp2_hdr));
+        failed = failed || pp_parse_hdr_ctx(&ctx, pp2_hdr, pp2_hdr_len, &pp_info) != -1000 || vendor.calls != 2;
+        pp_info_clear(&pp_info);
+        if (failed)
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+
+    /* Test AF_UNIX headers followed by TLVs and the path views */
+    printf("Running test: AF_UNIX with TLVs, pp2_get_unix_addrs()...");
+    {
+        pp_info_t pp_info_unix = {
+            .address_family = ADDR_FAMILY_UNIX,
+            .transport_protocol = TRANSPORT_PROTOCOL_STREAM,
+            .src_addr = "/run/mesh/client.sock",
+            .pp2_info = { .crc32c = 1, .pp2_ssl_info = { .ssl = 1 } }
+        };
+        /* The destination path fills its whole field */
+        char dst_path[sizeof(pp_info_unix.dst_addr)];
+        memset(dst_path, 'd', sizeof(dst_path));
+        memcpy(pp_info_unix.dst_addr, dst_path, sizeof(dst_path));
+        uint8_t failed = !pp_info_add_unique_id(&pp_info_unix, 4, (const uint8_t*) "mesh")
+                      || !pp_info_add_ssl(&pp_info_unix, "TLSv1.3", NULL, NULL, NULL, NULL, 0);
+        uint16_t pp2_hdr_len;
+        int32_t error;
+        uint8_t *pp2_hdr = pp_create_hdr(2, &pp_info_unix, &pp2_hdr_len, &error);
+        pp_info_clear(&pp_info_unix);
+
+        pp_info_t pp_info;
+        uint16_t length;
+        const uint8_t *value;
+        failed = failed || !pp2_hdr || pp_parse_hdr(pp2_hdr, pp2_hdr_len, &pp_info) != pp2_hdr_len
+                        || strcmp(pp_info.src_addr, "/run/mesh/client.sock") || memcmp(pp_info.dst_addr, dst_path, sizeof(dst_path))
+                        || pp_info.pp2_info.crc32c != 1 || !pp_info.pp2_info.pp2_ssl_info.ssl
+                        || !(value = pp_info_get_unique_id(&pp_info, &length)) || length != 4 || memcmp(value, "mesh", 4)
+                        || !(value = pp_info_get_ssl_version(&pp_info, &length)) || strcmp((const char*) value, "TLSv1.3");
+        pp_info_clear(&pp_info);
+
+        const uint8_t *src, *dst;
+        uint16_t src_len, dst_len;
+        failed = failed || pp2_get_unix_addrs(pp2_hdr, pp2_hdr_len, &src, &src_len, &dst, &dst_len) != pp2_hdr_len
+                        || src != pp2_hdr + 16 || src_len != strlen("/run/mesh/client.sock") || dst != pp2_hdr + 16 + 108 || dst_len != 108
+                        || pp2_get_unix_addrs(pp2_hdr_ssl, sizeof(pp2_hdr_ssl), &src, &src_len, &dst, &dst_len) != -ERR_PP2_ADDR_FAMILY;
+        free(pp2_hdr);
+        if (failed)
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+
+    /* Test the datagram API */
+    printf("Running test: pp_parse_dgram_hdr(), pp_dgram_iov_prepend()...");
+    {
+        pp_info_t pp_info_dgram = {
+            .address_family = ADDR_FAMILY_INET6,
+            .transport_protocol = TRANSPORT_PROTOCOL_DGRAM,
+            .src_addr = "2001:db8::1",
+            .dst_addr = "2001:db8::2",
+            .src_port = 50000,
+            .dst_port = 443,
+            .pp2_info = { .crc32c = 1 }
+        };
+        uint16_t pp2_hdr_len;
+        int32_t error;
+        uint8_t *pp2_hdr = pp_create_hdr(2, &pp_info_dgram, &pp2_hdr_len, &error);
+        uint8_t datagram[128];
+        memcpy(datagram, pp2_hdr, pp2_hdr_len);
+        memcpy(datagram + pp2_hdr_len, "QUIC", 4);
+
+        pp_ctx_t ctx;
+        pp_ctx_init(&ctx);
+        pp_info_t pp_info;
+        uint8_t failed = pp_parse_dgram_hdr(&ctx, datagram, pp2_hdr_len + 4, &pp_info) != pp2_hdr_len
+                      || pp_info.transport_protocol != TRANSPORT_PROTOCOL_DGRAM || pp_info.src_port != 50000
+                      || memcmp(datagram + pp2_hdr_len, "QUIC", 4);
+        pp_info_clear(&pp_info);
+        /* Truncated header */
+        failed = failed || pp_parse_dgram_hdr(&ctx, datagram, pp2_hdr_len - 1, &pp_info) != -ERR_PP2_LENGTH;
+        pp_info_clear(&pp_info);
+        /* A v1 line is payload */
+        uint8_t pp1_line[] = "PROXY UNKNOWN\r\n";
+        failed = failed || pp_parse_dgram_hdr(&ctx, pp1_line, sizeof(pp1_line) - 1, &pp_info) != 0;
+        /* Stream headers do not belong to datagrams, health checks do */
+        failed = failed || pp_parse_dgram_hdr(&ctx, pp2_hdr_ssl, sizeof(pp2_hdr_ssl), &pp_info) != -ERR_PP2_TRANSPORT_PROTOCOL;
+        pp_info_clear(&pp_info);
+        uint16_t healthcheck_hdr_len;
+        const uint8_t *healthcheck_hdr = pp2_get_healthcheck_hdr(1, &healthcheck_hdr_len);
+        memcpy(datagram, healthcheck_hdr, healthcheck_hdr_len);
+        failed = failed || pp_parse_dgram_hdr(&ctx, datagram, healthcheck_hdr_len, &pp_info) != healthcheck_hdr_len || !pp_info.pp2_info.local
+                        || ctx.stats.parsed != 2 || ctx.stats.parse_errors != 2;
+        pp_info_clear(&pp_info);
+
+#ifndef _WIN32
+        struct iovec payloads[3] = { { "a", 1 }, { "bb", 2 }, { "ccc", 3 } };
+        struct iovec iovs[2 * NUM_ELEMS(payloads)];
+        pp_dgram_iov_prepend(pp2_hdr, pp2_hdr_len, payloads, NUM_ELEMS(payloads), iovs);
+        for (i = 0; i < NUM_ELEMS(payloads); i++)
+        {
+            failed = failed || iovs[2 * i].iov_base != pp2_hdr || iovs[2 * i].iov_len != pp2_hdr_len
+                            || iovs[2 * i + 1].iov_base != payloads[i].iov_base || iovs[2 * i + 1].iov_len != i + 1;
+        }
+#endif
+        free(pp2_hdr);
+        if (failed)
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+
+    /* Test the SSL view */
+    printf("Running test: pp2_ssl_view_t...");
+    {
+        pp_info_t pp_info;
+        const pp2_ssl_view_t *view = &pp_info.pp2_info.pp2_ssl_view;
+        uint8_t failed = pp_parse_hdr(pp2_hdr_ssl, sizeof(pp2_hdr_ssl), &pp_info) != sizeof(pp2_hdr_ssl)
+                      || view->client != 0x07 || view->verify || view->unknown
+                      || view->version_len != 7 || memcmp(view->version, "TLSv1.2", 7)
+                      || view->cn_len != 11 || memcmp(view->cn, "example.com", 11)
+                      || view->cipher_len != 27 || memcmp(view->cipher, "ECDHE-RSA-AES128-GCM-SHA256", 27)
+                      || view->sig_alg_len != 6 || memcmp(view->sig_alg, "SHA256", 6)
+                      || view->key_alg_len != 7 || memcmp(view->key_alg, "RSA2048", 7);
+        pp_info_clear(&pp_info);
+
+        /* Unknown and repeated sub-TLVs are accepted */
+        uint8_t tlv_ssl[] = {
+            0x20, 0x00, 0x1a,                               /* PP2_TYPE_SSL */
+            0x01, 0x00, 0x00, 0x00, 0x02,                   /* client, verify */
+            0x21, 0x00, 0x07, 'T', 'L', 'S', 'v', '1', '.', '3',
+            0x2f, 0x00, 0x02, 'x', 'x',                     /* Unknown sub-TLV */
+            0x21, 0x00, 0x03, 'T', 'L', 'S'
+        };
+        uint8_t pp2_hdr[sizeof(pp2_hdr_vpce) + sizeof(tlv_ssl)];
+        int32_t pp2_hdr_len = pp2_forward_hdr(pp2_hdr_vpce, sizeof(pp2_hdr_vpce), NULL, tlv_ssl, sizeof(tlv_ssl), PP2_FORWARD_F_CRC32C, pp2_hdr, sizeof(pp2_hdr));
+        failed = failed || pp_parse_hdr(pp2_hdr, pp2_hdr_len, &pp_info) != pp2_hdr_len
+                        || view->client != 0x01 || view->verify != 2 || view->unknown != 1 || pp_info.pp2_info.pp2_ssl_info.cert_verified
+                        || view->version_len != 7 || memcmp(view->version, "TLSv1.3", 7) || view->cn || view->cipher_len;
+        pp_info_clear(&pp_info);
+
+        /* A repeated SSL TLV */
+        uint8_t tlv_ssl_twice[2 * sizeof(tlv_ssl)];
+        memcpy(tlv_ssl_twice, tlv_ssl, sizeof(tlv_ssl));
+        memcpy(tlv_ssl_twice + sizeof(tlv_ssl), tlv_ssl, sizeof(tlv_ssl));
+        uint8_t pp2_hdr_twice[sizeof(pp2_hdr_vpce) + sizeof(tlv_ssl_twice)];
+        pp2_hdr_len = pp2_forward_hdr(pp2_hdr_vpce, sizeof(pp2_hdr_vpce), NULL, tlv_ssl_twice, sizeof(tlv_ssl_twice), PP2_FORWARD_F_CRC32C, pp2_hdr_twice, sizeof(pp2_hdr_twice));
+        failed = failed || pp2_hdr_len <= 0 || pp_parse_hdr(pp2_hdr_twice, pp2_hdr_len, &pp_info) != -ERR_PP2_TYPE_SSL;
+        pp_info_clear(&pp_info);
+
+        /* <verify> is created in network byte order */
+        uint8_t v;
+        for (v = 0; v <= 1; v++)
+        {
+            pp_info_t pp_info_in = {
+                .address_family = ADDR_FAMILY_INET,
+                .transport_protocol = TRANSPORT_PROTOCOL_STREAM,
+                .src_addr = "192.168.10.100",
+                .dst_addr = "192.168.11.90",
+                .src_port = 42332,
+                .dst_port = 8080,
+                .pp2_info = { .pp2_ssl_info = { .ssl = 1, .cert_in_connection = 1, .cert_verified = v } }
+            };
+            uint16_t pp_hdr_len;
+            int32_t error;
+            uint8_t *pp_hdr = pp_info_add_ssl(&pp_info_in, "TLSv1.3", "TLS_AES_128_GCM_SHA256", NULL, NULL, NULL, 0)
+                            ? pp_create_hdr(2, &pp_info_in, &pp_hdr_len, &error) : NULL;
+            pp_info_clear(&pp_info_in);
+            failed = failed || !pp_hdr || pp_parse_hdr(pp_hdr, pp_hdr_len, &pp_info) != pp_hdr_len
+                            || view->verify != (uint32_t) !v || pp_info.pp2_info.pp2_ssl_info.cert_verified != v;
+            pp_info_clear(&pp_info);
+            free(pp_hdr);
+        }
+
+        /* A sub-TLV running past the SSL TLV */
+        tlv_ssl[sizeof(tlv_ssl) - 4] = 0x04;
+        pp2_hdr_len = pp2_forward_hdr(pp2_hdr_vpce, sizeof(pp2_hdr_vpce), NULL, tlv_ssl, sizeof(tlv_ssl), PP2_FORWARD_F_CRC32C, pp2_hdr, sizeof(pp2_hdr));
+        failed = failed || pp_parse_hdr(pp2_hdr, pp2_hdr_len, &pp_info) != -ERR_PP2_TYPE_SSL;
+        pp_info_clear(&pp_info);
+        if (failed)
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+
+    /* Test the TLV presence bitmap */
+    printf("Running test: pp2_info_t tlv_types...");
+    {
+        pp_info_t pp_info;
+        const uint8_t *tlv_types = pp_info.pp2_info.tlv_types;
+        uint16_t length;
+        uint8_t failed = pp_parse_hdr(pp2_hdr_vpce, sizeof(pp2_hdr_vpce), &pp_info) != sizeof(pp2_hdr_vpce)
+                      || !PP_TLV_TYPE_MASK_ISSET(tlv_types, PP2_TYPE_CRC32C) || !PP_TLV_TYPE_MASK_ISSET(tlv_types, PP2_TYPE_AWS)
+                      || !PP_TLV_TYPE_MASK_ISSET(tlv_types, PP2_TYPE_NOOP) || PP_TLV_TYPE_MASK_ISSET(tlv_types, PP2_TYPE_SSL)
+                      || PP_TLV_TYPE_MASK_ISSET(tlv_types, PP2_TYPE_AZURE) || pp_info_get_ssl_version(&pp_info, &length);
+        pp_info_clear(&pp_info);
+        failed = failed || pp_parse_hdr(pp2_hdr_ssl, sizeof(pp2_hdr_ssl), &pp_info) != sizeof(pp2_hdr_ssl)
+                        || !PP_TLV_TYPE_MASK_ISSET(tlv_types, PP2_TYPE_SSL) || !PP_TLV_TYPE_MASK_ISSET(tlv_types, PP2_SUBTYPE_SSL_KEY_ALG)
+                        || PP_TLV_TYPE_MASK_ISSET(tlv_types, PP2_TYPE_CRC32C) || !pp_info_get_ssl_key_alg(&pp_info, &length);
+        pp_info_clear(&pp_info);
+
+        /* The getters still find what pp_info_add_*() added */
+        const uint8_t *value;
+        failed = failed || !pp_info_add_alpn(&pp_info, 2, (const uint8_t*) "h2") || !pp_info_add_aws_vpce_id(&pp_info, "vpce-1")
+                        || !(value = pp_info_get_alpn(&pp_info, &length)) || length != 2 || memcmp(value, "h2", 2)
+                        || !(value = pp_info_get_aws_vpce_id(&pp_info, &length)) || length != 6 || memcmp(value, "vpce-1", 6)
+                        || !PP_TLV_TYPE_MASK_ISSET(tlv_types, PP2_TYPE_ALPN) || pp_info_get_authority(&pp_info, &length);
+
+        /* A tlv_array whose types were not recorded is still looked up */
+        memset(pp_info.pp2_info.tlv_types, 0, PP_TLV_TYPE_MASK_SIZE);
+        failed = failed || !(value = pp_info_get_alpn(&pp_info, &length)) || length != 2 || memcmp(value, "h2", 2)
+                        || !(value = pp_info_get_aws_vpce_id(&pp_info, &length)) || length != 6 || pp_info_get_authority(&pp_info, &length);
+        pp_info_clear(&pp_info);
+        if (failed)
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+
+    /* Test PP_CTX_F_STRICT_TLVS */
+    printf("Running test: PP_CTX_F_STRICT_TLVS...");
+    {
+        pp_ctx_t ctx;
+        pp_ctx_init(&ctx);
+        ctx.flags = PP_CTX_F_STRICT_TLVS;
+        pp_info_t pp_info;
+        uint8_t failed = pp_parse_hdr_ctx(&ctx, pp2_hdr_ssl, sizeof(pp2_hdr_ssl), &pp_info) != sizeof(pp2_hdr_ssl);
+        pp_info_clear(&pp_info);
+
+        /* A repeated singleton */
+        uint8_t tlvs[3 * (PP_STRICT_MAX_TLVS + 1)];
+        uint16_t tlvs_len = pp2_tlv_write(tlvs, sizeof(tlvs), PP2_TYPE_UNIQUE_ID, 2, (const uint8_t*) "id");
+        tlvs_len += pp2_tlv_write(tlvs + tlvs_len, sizeof(tlvs) - tlvs_len, PP2_TYPE_UNIQUE_ID, 2, (const uint8_t*) "id");
+        uint8_t pp2_hdr[sizeof(pp2_hdr_vpce) + sizeof(tlvs)];
+        int32_t pp2_hdr_len = pp2_forward_hdr(pp2_hdr_vpce, sizeof(pp2_hdr_vpce), NULL, tlvs, tlvs_len, PP2_FORWARD_F_CRC32C, pp2_hdr, sizeof(pp2_hdr));
+        failed = failed || pp_parse_hdr_ctx(&ctx, pp2_hdr, pp2_hdr_len, &pp_info) != -ERR_PP2_TLV_DUPLICATE;
+        pp_info_clear(&pp_info);
+        failed = failed || pp_parse_hdr(pp2_hdr, pp2_hdr_len, &pp_info) != pp2_hdr_len;
+        pp_info_clear(&pp_info);
+
+        /* The header already has AWS, NOOP and CRC32C: PP_STRICT_MAX_TLVS in total and then one more */
+        for (tlvs_len = 0; tlvs_len < 3 * (PP_STRICT_MAX_TLVS - 3); tlvs_len += 3)
+        {
+            pp2_tlv_write(tlvs + tlvs_len, sizeof(tlvs) - tlvs_len, PP2_TYPE_NOOP, 0, (const uint8_t*) "");
+        }
+        pp2_hdr_len = pp2_forward_hdr(pp2_hdr_vpce, sizeof(pp2_hdr_vpce), NULL, tlvs, tlvs_len, PP2_FORWARD_F_CRC32C, pp2_hdr, sizeof(pp2_hdr));
+        failed = failed || pp_parse_hdr_ctx(&ctx, pp2_hdr, pp2_hdr_len, &pp_info) != pp2_hdr_len;
+        pp_info_clear(&pp_info);
+        tlvs_len += pp2_tlv_write(tlvs + tlvs_len, sizeof(tlvs) - tlvs_len, PP2_TYPE_NOOP, 0, (const uint8_t*) "");
+        pp2_hdr_len = pp2_forward_hdr(pp2_hdr_vpce, sizeof(pp2_hdr_vpce), NULL, tlvs, tlvs_len, PP2_FORWARD_F_CRC32C, pp2_hdr, sizeof(pp2_hdr));
+        failed = failed || pp_parse_hdr_ctx(&ctx, pp2_hdr, pp2_hdr_len, &pp_info) != -ERR_PP2_TLV_COUNT;
+        pp_info_clear(&pp_info);
+        failed = failed || pp_parse_hdr(pp2_hdr, pp2_hdr_len, &pp_info) != pp2_hdr_len;
+        pp_info_clear(&pp_info);
+        if (failed)
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+
+    /* Test the callback parser */
+    printf("Running test: pp_parse_hdr_cb()...");
+    {
+        test_parse_cb_t parsed;
+        memset(&parsed, 0, sizeof(parsed));
+        const uint8_t ipv4_src[] = { 192, 168, 10, 100 };
+        uint8_t failed = pp_parse_hdr_cb(pp2_hdr_vpce, sizeof(pp2_hdr_vpce), &test_parse_cb, &parsed) != sizeof(pp2_hdr_vpce)
+                      || parsed.version != 2 || parsed.local || parsed.address_family != ADDR_FAMILY_INET
+                      || parsed.transport_protocol != TRANSPORT_PROTOCOL_STREAM || parsed.addr_len != 4
+                      || memcmp(parsed.src_addr, pp2_hdr_vpce + 16, 4) || parsed.tlvs != 3 || parsed.last_tlv_type != PP2_TYPE_NOOP;
+
+        /* v1 through the same callbacks */
+        uint8_t pp1_hdr_tcp4[] = "PROXY TCP4 192.168.10.100 192.168.11.90 42332 8080\r\n";
+        memset(&parsed, 0, sizeof(parsed));
+        failed = failed || pp_parse_hdr_cb(pp1_hdr_tcp4, sizeof(pp1_hdr_tcp4) - 1, &test_parse_cb, &parsed) != sizeof(pp1_hdr_tcp4) - 1
+                        || parsed.version != 1 || parsed.address_family != ADDR_FAMILY_INET || parsed.addr_len != 4
+                        || memcmp(parsed.src_addr, ipv4_src, 4) || parsed.src_port != 42332 || parsed.dst_port != 8080 || parsed.tlvs;
+
+        /* NULL callbacks are skipped and a callback's error aborts the parsing */
+        const pp_parse_cb_t tlvs_only = { NULL, NULL, NULL, test_on_tlv };
+        memset(&parsed, 0, sizeof(parsed));
+        parsed.abort_tlvs = 1;
+        failed = failed || pp_parse_hdr_cb(pp2_hdr_vpce, sizeof(pp2_hdr_vpce), &tlvs_only, &parsed) != -1000 || parsed.tlvs != 1 || parsed.version;
+
+        /* A corrupted checksum is reported after the TLVs */
+        uint8_t pp2_hdr[sizeof(pp2_hdr_vpce)];
+        memcpy(pp2_hdr, pp2_hdr_vpce, sizeof(pp2_hdr));
+        pp2_hdr[sizeof(pp2_hdr) - 1] ^= 1;
+        memset(&parsed, 0, sizeof(parsed));
+        failed = failed || pp_parse_hdr_cb(pp2_hdr, sizeof(pp2_hdr), &test_parse_cb, &parsed) != -ERR_PP2_TYPE_CRC32C
+                        || pp_parse_hdr_cb((const uint8_t*) "GET / HTTP/1.1\r\n", 16, &test_parse_cb, &parsed) != 0;
+        if (failed)
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+
+    /* Test v1 lines overflowing the tokenizer's fixed size buffers */
+    printf("Running test: v1 PROXY protocol header: over long port, no CRLF...");
+    {
+        const char pp1_hdr_src_port[] = "PROXY TCP4 192.168.10.100 192.168.11.90 0000000042332 8080\r\n";
+        const char pp1_hdr_dst_port[] = "PROXY TCP4 192.168.10.100 192.168.11.90 42332 0000000008080\r\n";
+        uint8_t pp1_hdr_no_crlf[108];
+        memcpy(pp1_hdr_no_crlf, "PROXY TCP4 ", 11);
+        memset(pp1_hdr_no_crlf + 11, '1', sizeof(pp1_hdr_no_crlf) - 11);
+        test_parse_cb_t parsed;
+        memset(&parsed, 0, sizeof(parsed));
+        pp_builder_t builder;
+        pp_builder_init(&builder);
+        const uint8_t *pp_hdr;
+        uint16_t pp_hdr_len;
+        pp_info_t pp_info;
+        uint8_t failed = pp_parse_hdr((uint8_t*) pp1_hdr_src_port, sizeof(pp1_hdr_src_port) - 1, &pp_info) != -ERR_PP1_SRC_PORT;
+        pp_info_clear(&pp_info);
+        failed = failed || pp_parse_hdr((uint8_t*) pp1_hdr_dst_port, sizeof(pp1_hdr_dst_port) - 1, &pp_info) != -ERR_PP1_DST_PORT;
+        pp_info_clear(&pp_info);
+        failed = failed || pp_parse_hdr(pp1_hdr_no_crlf, sizeof(pp1_hdr_no_crlf), &pp_info) != -ERR_PP1_CRLF;
+        pp_info_clear(&pp_info);
+        failed = failed || pp_parse_hdr_cb((const uint8_t*) pp1_hdr_src_port, sizeof(pp1_hdr_src_port) - 1, &test_parse_cb, &parsed) != -ERR_PP1_SRC_PORT
+                        || pp_parse_hdr_cb((const uint8_t*) pp1_hdr_dst_port, sizeof(pp1_hdr_dst_port) - 1, &test_parse_cb, &parsed) != -ERR_PP1_DST_PORT
+                        || pp_parse_hdr_cb(pp1_hdr_no_crlf, sizeof(pp1_hdr_no_crlf), &test_parse_cb, &parsed) != -ERR_PP1_CRLF
+                        || pp_transcode(&builder, (const uint8_t*) pp1_hdr_src_port, sizeof(pp1_hdr_src_port) - 1, &pp_hdr, &pp_hdr_len) != -ERR_PP1_SRC_PORT
+                        || pp_transcode(&builder, pp1_hdr_no_crlf, sizeof(pp1_hdr_no_crlf), &pp_hdr, &pp_hdr_len) != -ERR_PP1_CRLF;
+        pp_builder_free(&builder);
+        if (failed)
+        {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+
+#ifdef ALLOC_COUNTING
+    /* Test the allocation budgets */
+    {
+        uint8_t pp1_hdr_tcp4[] = "PROXY TCP4 192.168.10.100 192.168.11.90 42332 8080\r\n";
+        uint16_t healthcheck_hdr_len;
+        uint8_t *healthcheck_hdr = (uint8_t*) pp2_get_healthcheck_hdr(0, &healthcheck_hdr_len);
+        const alloc_budget_t alloc_budgets[] = {
+            { "parse v1 TCP4", ALLOC_OP_PARSE, pp1_hdr_tcp4, sizeof(pp1_hdr_tcp4) - 1, 0, 0 },
+            { "parse v2 healthcheck", ALLOC_OP_PARSE, healthcheck_hdr, healthcheck_hdr_len, 0, 0 },
+            { "parse v2 IPv4 with CRC32C and AWS", ALLOC_OP_PARSE, pp2_hdr_vpce, sizeof(pp2_hdr_vpce), 3, 152 },
+            { "parse v2 IPv4 with SSL", ALLOC_OP_PARSE, pp2_hdr_ssl, sizeof(pp2_hdr_ssl), 6, 224 },
+            { "callback parse v1 TCP4", ALLOC_OP_PARSE_CB, pp1_hdr_tcp4, sizeof(pp1_hdr_tcp4) - 1, 0, 0 },
+            { "callback parse v2 IPv4 with SSL", ALLOC_OP_PARSE_CB, pp2_hdr_ssl, sizeof(pp2_hdr_ssl), 0, 0 },
+            { "create v1 TCP4", ALLOC_OP_CREATE_V1, NULL, 0, 1, 56 },
+            { "create v2 IPv4 with CRC32C", ALLOC_OP_CREATE_V2, NULL, 0, 1, 40 },
+            { "builder v2 IPv4 with SSL, steady state", ALLOC_OP_BUILDER, NULL, 0, 0, 0 },
+            { "TLV iteration v2 IPv4 with SSL", ALLOC_OP_TLV_ITER, pp2_hdr_ssl, sizeof(pp2_hdr_ssl), 0, 0 },
+            { "forward v2 IPv4 with SSL", ALLOC_OP_FORWARD, pp2_hdr_ssl, sizeof(pp2_hdr_ssl), 0, 0 },
+            { "transcode v1 TCP4 to v2, steady state", ALLOC_OP_TRANSCODE, pp1_hdr_tcp4, sizeof(pp1_hdr_tcp4) - 1, 0, 0 },
+            { "CRC32C verification v2 IPv4 with CRC32C and AWS", ALLOC_OP_VERIFY_CRC32C, pp2_hdr_vpce, sizeof(pp2_hdr_vpce), 0, 0 },
+        };
+        for (i = 0; i < NUM_ELEMS(alloc_budgets); i++)
+        {
+            printf("Running test: allocation budget of %s...", alloc_budgets[i].name);
+            if (!alloc_budget_run(&alloc_budgets[i])
+                || alloc_stats.allocations > alloc_budgets[i].max_allocations || alloc_stats.peak_bytes > alloc_budgets[i].max_peak_bytes)
+            {
+                printf("FAILED (allocations: %u/%u, peak bytes: %ld/%ld)\n", alloc_stats.allocations, alloc_budgets[i].max_allocations,
+                       (long) alloc_stats.peak_bytes, (long) alloc_budgets[i].max_peak_bytes);
+                return EXIT_FAILURE;
+            }
+            printf("PASSED\n");
+        }
+    }
+#endif
+
     printf("ALl tests completed successfully\n");
     return EXIT_SUCCESS;
 }